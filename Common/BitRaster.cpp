@@ -0,0 +1,267 @@
+#include "BitRaster.h"
+
+#include <ErrorHandling.h>
+
+#include <algorithm>
+#include <bitset>
+#include <cstdlib>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define BIT_RASTER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// dst pixel x = src pixel x + shift, pixels outside of row are clear
+	void ShiftRow(const uint64_t* src, uint64_t* dst, size_t words, int shift)
+	{
+		const auto wordAt = [&](ptrdiff_t i) { return i >= 0 && i < static_cast<ptrdiff_t>(words) ? src[i] : 0; };
+		const auto distance = std::abs(shift);
+		const auto wordShift = static_cast<ptrdiff_t>(distance / BitRaster::WordBits);
+		const auto bitShift = distance % BitRaster::WordBits;
+		for (ptrdiff_t i = 0; i < static_cast<ptrdiff_t>(words); ++i)
+		{
+			if (shift >= 0)
+			{
+				// higher pixels move down
+				dst[i] = wordAt(i + wordShift) >> bitShift;
+				if (bitShift != 0)
+				{
+					dst[i] |= wordAt(i + wordShift + 1) << (BitRaster::WordBits - bitShift);
+				}
+			}
+			else
+			{
+				dst[i] = wordAt(i - wordShift) << bitShift;
+				if (bitShift != 0)
+				{
+					dst[i] |= wordAt(i - wordShift - 1) >> (BitRaster::WordBits - bitShift);
+				}
+			}
+		}
+	}
+
+	void OrRow(const uint64_t* src, uint64_t* dst, size_t words)
+	{
+		for (size_t i = 0; i < words; ++i)
+		{
+			dst[i] |= src[i];
+		}
+	}
+
+	// -1 for empty row
+	int FindFirstSet(const uint64_t* row, size_t words)
+	{
+		for (size_t i = 0; i < words; ++i)
+		{
+			if (row[i] != 0)
+			{
+				return static_cast<int>(i) * BitRaster::WordBits + CountTrailingZeros(row[i]);
+			}
+		}
+		return -1;
+	}
+
+	void SetBits(uint64_t* row, int begin, int end)
+	{
+		for (auto x = begin; x < end; ++x)
+		{
+			row[x / BitRaster::WordBits] |= 1ull << (x % BitRaster::WordBits);
+		}
+	}
+} //namespace
+
+BitRaster::BitRaster() :
+	width_(0),
+	height_(0),
+	rowWords_(0)
+{
+}
+
+BitRaster::BitRaster(int width, int height) :
+	width_(width),
+	height_(height),
+	rowWords_((width + WordBits - 1) / WordBits),
+	words_(rowWords_ * height, 0)
+{
+}
+
+BitRaster::BitRaster(const std::vector<uint8_t>& raster, int width, int height, uint8_t threshold) :
+	BitRaster(width, height)
+{
+	ASSERT(raster.size() == static_cast<size_t>(width) * height);
+
+#ifdef BIT_RASTER_SSE2
+	// unsigned pixel >= threshold is max(pixel, threshold) == pixel, its sign bit goes to mask
+	const auto thresholds = _mm_set1_epi8(static_cast<char>(threshold));
+#endif
+	for (auto y = 0; y < height; ++y)
+	{
+		const auto row = &raster[static_cast<size_t>(y) * width];
+		const auto outRow = GetRow(y);
+		auto x = 0;
+#ifdef BIT_RASTER_SSE2
+		for (; x + WordBits <= width; x += WordBits)
+		{
+			uint64_t word = 0;
+			for (auto i = 0; i < WordBits; i += 16)
+			{
+				const auto values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x + i));
+				const auto mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(values, thresholds), values));
+				word |= static_cast<uint64_t>(static_cast<uint16_t>(mask)) << i;
+			}
+			outRow[x / WordBits] = word;
+		}
+#endif
+		for (; x < width; ++x)
+		{
+			if (row[x] >= threshold)
+			{
+				outRow[x / WordBits] |= 1ull << (x % WordBits);
+			}
+		}
+	}
+}
+
+void BitRaster::ToBytes(std::vector<uint8_t>& out) const
+{
+	out.resize(static_cast<size_t>(width_) * height_);
+	for (auto y = 0; y < height_; ++y)
+	{
+		const auto row = GetRow(y);
+		const auto outRow = &out[static_cast<size_t>(y) * width_];
+		for (auto x = 0; x < width_; ++x)
+		{
+			outRow[x] = (row[x / WordBits] >> (x % WordBits) & 1) ? 255 : 0;
+		}
+	}
+}
+
+void BitRaster::Set(int x, int y, bool value)
+{
+	auto& word = GetRow(y)[x / WordBits];
+	const auto bit = 1ull << (x % WordBits);
+	word = value ? word | bit : word & ~bit;
+}
+
+size_t BitRaster::Count() const
+{
+	size_t count = 0;
+	for (const auto word : words_)
+	{
+		count += std::bitset<WordBits>(word).count();
+	}
+	return count;
+}
+
+bool BitRaster::Any() const
+{
+	return std::any_of(words_.begin(), words_.end(), [](uint64_t word) { return word != 0; });
+}
+
+BitRaster& BitRaster::operator|=(const BitRaster& other)
+{
+	ASSERT(width_ == other.width_ && height_ == other.height_);
+	OrRow(other.words_.data(), words_.data(), words_.size());
+	return *this;
+}
+
+BitRaster& BitRaster::operator&=(const BitRaster& other)
+{
+	ASSERT(width_ == other.width_ && height_ == other.height_);
+	for (size_t i = 0; i < words_.size(); ++i)
+	{
+		words_[i] &= other.words_[i];
+	}
+	return *this;
+}
+
+void BitRaster::Subtract(const BitRaster& other)
+{
+	ASSERT(width_ == other.width_ && height_ == other.height_);
+	for (size_t i = 0; i < words_.size(); ++i)
+	{
+		words_[i] &= ~other.words_[i];
+	}
+}
+
+// Window OR by doubling: after steps of 1, 2, 4, ... span s covers pixels [x, x + s) with s <= window < 2s,
+// so window [x - radius, x + radius] is union of spans starting at x - radius & x + radius + 1 - s.
+// Spans are clipped by the raster, so only windows crossing its start (a prefix) need separate handling.
+BitRaster DilateSquare(const BitRaster& in, int radius)
+{
+	if (radius <= 0)
+	{
+		return in;
+	}
+
+	const auto window = 2 * radius + 1;
+	const auto words = in.GetRowWords();
+	const auto width = in.GetWidth();
+	const auto height = in.GetHeight();
+
+	BitRaster rows(width, height);
+	std::vector<uint64_t> span(words);
+	std::vector<uint64_t> shifted(words);
+	for (auto y = 0; y < height; ++y)
+	{
+		std::copy(in.GetRow(y), in.GetRow(y) + words, span.begin());
+		auto spanSize = 1;
+		for (; spanSize * 2 <= window; spanSize *= 2)
+		{
+			ShiftRow(span.data(), shifted.data(), words, spanSize);
+			OrRow(shifted.data(), span.data(), words);
+		}
+
+		const auto outRow = rows.GetRow(y);
+		ShiftRow(span.data(), outRow, words, -radius);
+		ShiftRow(span.data(), shifted.data(), words, radius + 1 - spanSize);
+		OrRow(shifted.data(), outRow, words);
+
+		// pixel x < radius is set when first set pixel is in [0, x + radius]
+		const auto first = FindFirstSet(in.GetRow(y), words);
+		if (first >= 0)
+		{
+			SetBits(outRow, std::max(first - radius, 0), std::min(radius, width));
+		}
+
+		// bits shifted up past the last pixel
+		if (width % BitRaster::WordBits != 0)
+		{
+			outRow[words - 1] &= (1ull << (width % BitRaster::WordBits)) - 1;
+		}
+	}
+
+	// same along columns, starting rows get prefix ORs before spans overwrite rows
+	BitRaster out(width, height);
+	std::vector<uint64_t> prefix(words, 0);
+	for (auto y = 0; y < std::min(radius, height); ++y)
+	{
+		for (auto i = y == 0 ? 0 : y + radius; i <= y + radius && i < height; ++i)
+		{
+			OrRow(rows.GetRow(i), prefix.data(), words);
+		}
+		std::copy(prefix.begin(), prefix.end(), out.GetRow(y));
+	}
+
+	// spans of rows are updated in place as row y + s is not updated yet
+	auto spanSize = 1;
+	for (; spanSize * 2 <= window; spanSize *= 2)
+	{
+		for (auto y = 0; y + spanSize < height; ++y)
+		{
+			OrRow(rows.GetRow(y + spanSize), rows.GetRow(y), words);
+		}
+	}
+
+	for (auto y = radius; y < height; ++y)
+	{
+		OrRow(rows.GetRow(y - radius), out.GetRow(y), words);
+		if (y + radius + 1 - spanSize < height)
+		{
+			OrRow(rows.GetRow(y + radius + 1 - spanSize), out.GetRow(y), words);
+		}
+	}
+	return out;
+}
\ No newline at end of file
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Index of lowest set bit, word should not be 0.
+inline int CountTrailingZeros(uint64_t word)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanForward64(&index, word);
+	return static_cast<int>(index);
+#elif defined(_MSC_VER)
+	unsigned long index;
+	if (_BitScanForward(&index, static_cast<unsigned long>(word)))
+	{
+		return static_cast<int>(index);
+	}
+	_BitScanForward(&index, static_cast<unsigned long>(word >> 32));
+	return static_cast<int>(index) + 32;
+#else
+	return __builtin_ctzll(word);
+#endif
+}
+
+// Binary raster with 1 bit per pixel: pixel x of row is bit x % 64 of word x / 64.
+// Rows are padded to whole words, padding bits are always clear.
+class BitRaster
+{
+public:
+	static const int WordBits = 64;
+
+	BitRaster();
+	BitRaster(int width, int height);
+	// pixels not below threshold are set
+	BitRaster(const std::vector<uint8_t>& raster, int width, int height, uint8_t threshold);
+
+	// set pixels are 255, clear ones are 0
+	void ToBytes(std::vector<uint8_t>& out) const;
+
+	int GetWidth() const { return width_; }
+	int GetHeight() const { return height_; }
+	size_t GetRowWords() const { return rowWords_; }
+	const uint64_t* GetRow(int y) const { return &words_[static_cast<size_t>(y) * rowWords_]; }
+	uint64_t* GetRow(int y) { return &words_[static_cast<size_t>(y) * rowWords_]; }
+
+	bool Get(int x, int y) const { return (GetRow(y)[x / WordBits] >> (x % WordBits) & 1) != 0; }
+	void Set(int x, int y, bool value);
+
+	// number of set pixels
+	size_t Count() const;
+	bool Any() const;
+
+	BitRaster& operator|=(const BitRaster& other);
+	BitRaster& operator&=(const BitRaster& other);
+	// clears pixels set in other
+	void Subtract(const BitRaster& other);
+
+	// Calls action(xBegin, xEnd) for each run of set pixels in row.
+	template <typename Action>
+	void ForEachRun(int y, const Action& action) const;
+
+private:
+	int width_;
+	int height_;
+	size_t rowWords_;
+	std::vector<uint64_t> words_;
+};
+
+// Max over (2 * radius + 1)^2 square: rows & columns are ORed with their shifted copies of doubling distance,
+// so each pass costs log2(radius) operations per 64 pixels.
+BitRaster DilateSquare(const BitRaster& in, int radius);
+
+template <typename Action>
+void BitRaster::ForEachRun(int y, const Action& action) const
+{
+	const auto row = GetRow(y);
+	auto runBegin = -1;
+	for (size_t i = 0; i < rowWords_; ++i)
+	{
+		const auto base = static_cast<int>(i) * WordBits;
+		// alternately looks for first set & first clear bit above already processed ones
+		for (auto bit = 0; bit < WordBits;)
+		{
+			const auto unprocessed = ~0ull << bit;
+			const auto candidates = (runBegin < 0 ? row[i] : ~row[i]) & unprocessed;
+			if (candidates == 0)
+			{
+				break;
+			}
+
+			bit = CountTrailingZeros(candidates);
+			if (runBegin < 0)
+			{
+				runBegin = base + bit;
+			}
+			else
+			{
+				action(runBegin, base + bit);
+				runBegin = -1;
+			}
+		}
+	}
+
+	// run reaching the end of row without padding
+	if (runBegin >= 0)
+	{
+		action(runBegin, width_);
+	}
+}
\ No newline at end of file
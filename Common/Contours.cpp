@@ -0,0 +1,236 @@
+#include "Contours.h"
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace
+{
+	struct Bounds
+	{
+		glm::vec2 min;
+		glm::vec2 max;
+	};
+
+	Bounds CalculateBounds(const std::vector<glm::vec2>& points)
+	{
+		Bounds bounds{ glm::vec2(std::numeric_limits<float>::max()), glm::vec2(std::numeric_limits<float>::lowest()) };
+		for (const auto& p : points)
+		{
+			bounds.min = glm::min(bounds.min, p);
+			bounds.max = glm::max(bounds.max, p);
+		}
+		return bounds;
+	}
+
+	bool IsInside(const glm::vec2& point, const std::vector<glm::vec2>& polygon)
+	{
+		bool inside = false;
+		for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+		{
+			const auto& a = polygon[i];
+			const auto& b = polygon[j];
+			if ((a.y > point.y) != (b.y > point.y) &&
+				point.x < (b.x - a.x) * (point.y - a.y) / (b.y - a.y) + a.x)
+			{
+				inside = !inside;
+			}
+		}
+		return inside;
+	}
+
+	float Cross(const glm::vec2& a, const glm::vec2& b)
+	{
+		return a.x * b.y - a.y * b.x;
+	}
+
+	glm::vec2 RightNormal(const glm::vec2& from, const glm::vec2& to)
+	{
+		const auto direction = glm::normalize(to - from);
+		return glm::vec2(direction.y, -direction.x);
+	}
+
+	void AddPolygon(const std::vector<glm::vec2>& polygon, std::vector<SliceEdge>& edges)
+	{
+		for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+		{
+			SliceEdge edge{};
+			edge.from = polygon[j];
+			edge.to = polygon[i];
+			edges.push_back(edge);
+		}
+	}
+
+	// Counter-clockwise pie slice from startNormal to endNormal direction.
+	void AddWedge(const glm::vec2& center, const glm::vec2& startNormal, float sweep, float distance, float angleStep,
+		std::vector<glm::vec2>& polygon, std::vector<SliceEdge>& edges)
+	{
+		const auto steps = std::max(1, static_cast<int>(std::ceil(sweep / angleStep)));
+		const auto startAngle = std::atan2(startNormal.y, startNormal.x);
+
+		polygon.clear();
+		polygon.push_back(center);
+		for (auto i = 0; i <= steps; ++i)
+		{
+			const auto angle = startAngle + sweep * i / steps;
+			polygon.push_back(center + glm::vec2(std::cos(angle), std::sin(angle)) * distance);
+		}
+		AddPolygon(polygon, edges);
+	}
+} //namespace
+
+float CalculateSignedArea(const std::vector<glm::vec2>& points)
+{
+	float area = 0.0f;
+	for (size_t i = 0, j = points.size() - 1; i < points.size(); j = i++)
+	{
+		area += points[j].x * points[i].y - points[i].x * points[j].y;
+	}
+	return area * 0.5f;
+}
+
+std::vector<float> CalculateIslandAreas(const std::vector<Contour>& contours)
+{
+	std::vector<float> areas(contours.size(), 0.0f);
+	std::vector<Bounds> bounds(contours.size());
+	for (size_t i = 0; i < contours.size(); ++i)
+	{
+		if (contours[i].closed)
+		{
+			areas[i] = CalculateSignedArea(contours[i].points);
+			bounds[i] = CalculateBounds(contours[i].points);
+		}
+	}
+
+	// outer contours sorted by left side of bounds: ones which may contain hole are prefix of the list
+	std::vector<size_t> outers;
+	for (size_t i = 0; i < contours.size(); ++i)
+	{
+		if (areas[i] > 0.0f)
+		{
+			outers.push_back(i);
+		}
+	}
+	std::sort(outers.begin(), outers.end(), [&](size_t a, size_t b) { return bounds[a].min.x < bounds[b].min.x; });
+
+	// hole belongs to smallest outer contour containing it, so only outer contours which bounds contain
+	// bounds of hole are tested in order of area until the first one containing the hole
+	const auto NoParent = std::numeric_limits<size_t>::max();
+	std::vector<size_t> parents(contours.size(), NoParent);
+	std::vector<float> islandAreas(contours.size(), std::numeric_limits<float>::max());
+	std::vector<size_t> candidates;
+	for (size_t i = 0; i < contours.size(); ++i)
+	{
+		if (areas[i] > 0.0f)
+		{
+			islandAreas[i] = areas[i];
+		}
+		else if (areas[i] < 0.0f)
+		{
+			const auto& hole = bounds[i];
+			const auto outersEnd = std::upper_bound(outers.begin(), outers.end(), hole.min.x,
+				[&](float x, size_t outer) { return x < bounds[outer].min.x; });
+
+			candidates.clear();
+			for (auto outer = outers.begin(); outer != outersEnd; ++outer)
+			{
+				const auto& candidate = bounds[*outer];
+				if (candidate.max.x >= hole.max.x && candidate.min.y <= hole.min.y && candidate.max.y >= hole.max.y)
+				{
+					candidates.push_back(*outer);
+				}
+			}
+			std::sort(candidates.begin(), candidates.end(), [&](size_t a, size_t b) {
+				return areas[a] < areas[b] || (areas[a] == areas[b] && a < b);
+			});
+
+			const auto& point = contours[i].points.front();
+			for (const auto candidate : candidates)
+			{
+				if (IsInside(point, contours[candidate].points))
+				{
+					parents[i] = candidate;
+					break;
+				}
+			}
+		}
+	}
+
+	for (size_t i = 0; i < contours.size(); ++i)
+	{
+		if (parents[i] != NoParent)
+		{
+			islandAreas[parents[i]] += areas[i];
+		}
+	}
+
+	for (size_t i = 0; i < contours.size(); ++i)
+	{
+		if (parents[i] != NoParent)
+		{
+			islandAreas[i] = islandAreas[parents[i]];
+		}
+	}
+
+	return islandAreas;
+}
+
+void OffsetContour(const Contour& contour, float distance, float arcTolerance, std::vector<SliceEdge>& edges)
+{
+	const auto& points = contour.points;
+	if (points.size() < 2 || distance <= 0.0f)
+	{
+		return;
+	}
+
+	const auto Pi = 3.14159265358979f;
+	const auto angleStep = arcTolerance < distance ? 2.0f * std::acos(1.0f - arcTolerance / distance) : Pi / 4;
+
+	const auto count = points.size();
+	const auto segments = contour.closed ? count : count - 1;
+
+	std::vector<glm::vec2> polygon;
+	polygon.reserve(static_cast<size_t>(2 * Pi / angleStep) + 3);
+
+	for (size_t i = 0; i < segments; ++i)
+	{
+		const auto& a = points[i];
+		const auto& b = points[(i + 1) % count];
+		if (a == b)
+		{
+			continue;
+		}
+
+		const auto offset = RightNormal(a, b) * distance;
+		polygon.assign({ a + offset, b + offset, b, a });
+		AddPolygon(polygon, edges);
+	}
+
+	const auto cornerBegin = contour.closed ? 0 : 1;
+	const auto cornerEnd = contour.closed ? count : count - 1;
+	for (size_t i = cornerBegin; i < cornerEnd; ++i)
+	{
+		const auto& previous = points[(i + count - 1) % count];
+		const auto& current = points[i];
+		const auto& next = points[(i + 1) % count];
+		if (previous == current || current == next)
+		{
+			continue;
+		}
+
+		// left turn is convex corner of material on the left
+		const auto startNormal = RightNormal(previous, current);
+		const auto endNormal = RightNormal(current, next);
+		const auto sweep = std::atan2(Cross(startNormal, endNormal), glm::dot(startNormal, endNormal));
+		if (sweep > 0.0f)
+		{
+			AddWedge(current, startNormal, sweep, distance, angleStep, polygon, edges);
+		}
+	}
+
+	if (!contour.closed)
+	{
+		AddWedge(points.front(), glm::vec2(1.0f, 0.0f), 2 * Pi, distance, angleStep, polygon, edges);
+		AddWedge(points.back(), glm::vec2(1.0f, 0.0f), 2 * Pi, distance, angleStep, polygon, edges);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "MeshSlicer.h"
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Positive for counter-clockwise contour.
+float CalculateSignedArea(const std::vector<glm::vec2>& points);
+
+// Area of island (outer contour minus its holes) each contour belongs to.
+// Contours should have material on the left, so outer ones are counter-clockwise.
+// Open contours & holes without outer contour get maximum float value.
+std::vector<float> CalculateIslandAreas(const std::vector<Contour>& contours);
+
+// Appends closed edges of region swept by contour offset outwards from material by distance:
+// rectangle on the right of each edge & arc wedge at each convex corner (full disk at open contour ends).
+// Rasterized together with contour by nonzero rule they give exact offset polygon.
+// arcTolerance: maximum distance of arc approximation from true circle.
+void OffsetContour(const Contour& contour, float distance, float arcTolerance, std::vector<SliceEdge>& edges);
\ No newline at end of file
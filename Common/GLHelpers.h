@@ -101,6 +101,15 @@ struct GLProgramStrategy
 	static void Delete(GLuint handle);
 };
 
+#ifdef ANGLE
+// GL_EXT_occlusion_query_boolean
+struct GLQueryStrategy
+{
+	static GLuint Create();
+	static void Delete(GLuint handle);
+};
+#endif
+
 typedef GLHandle<GLBufferStrategy> GLBuffer;
 typedef GLHandle<GLTextureStrategy> GLTexture;
 typedef GLHandle<GLFramebufferStrategy> GLFramebuffer;
@@ -108,6 +117,9 @@ typedef GLHandle<GLRenderbufferStrategy> GLRenderbuffer;
 typedef GLHandle<GLFragmentShaderStrategy> GLFragmentShader;
 typedef GLHandle<GLVertexShaderStrategy> GLVertexShader;
 typedef GLHandle<GLProgramStrategy> GLProgram;
+#ifdef ANGLE
+typedef GLHandle<GLQueryStrategy> GLQuery;
+#endif
 
 #define SHADER(...) #__VA_ARGS__
 
@@ -118,6 +130,19 @@ inline GLProgram CreateProgram(const GLVertexShader& vertexShader, const GLFragm
 inline void GlCheck(const std::string& s);
 #define GL_CHECK() GlCheck("GlCheck failed at "FILE_LINE)
 
+inline bool IsGLExtensionSupported(const std::string& extension)
+{
+	const auto extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+	if (!extensions)
+	{
+		return false;
+	}
+
+	// whole word match: some extension names are prefixes of others
+	const std::string extensionsString = std::string(" ") + extensions + " ";
+	return extensionsString.find(" " + extension + " ") != std::string::npos;
+}
+
 inline void CompileShader(GLuint shader, const std::string& source)
 {
 	const char *sourceArray[1] = { source.c_str() };
@@ -260,3 +285,8 @@ inline void GLVertexShaderStrategy::Delete(GLuint handle) { glDeleteShader(handl
 
 inline GLuint GLProgramStrategy::Create() { return glCreateProgram(); }
 inline void GLProgramStrategy::Delete(GLuint handle) { glDeleteProgram(handle); }
+
+#ifdef ANGLE
+inline GLuint GLQueryStrategy::Create() { GLuint handle = 0; glGenQueriesEXT(1, &handle); return handle; }
+inline void GLQueryStrategy::Delete(GLuint handle) { glDeleteQueriesEXT(1, &handle); }
+#endif
@@ -0,0 +1,218 @@
+#include "IslandTracker.h"
+
+#include <ErrorHandling.h>
+
+#include <boost/log/trivial.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+	uint32_t FindRoot(std::vector<uint32_t>& parents, uint32_t index)
+	{
+		while (parents[index] != index)
+		{
+			parents[index] = parents[parents[index]];
+			index = parents[index];
+		}
+		return index;
+	}
+
+	// islands of previous layer go before components of current one & older islands before younger ones,
+	// so root of united nodes is the oldest island
+	void Unite(std::vector<uint32_t>& parents, uint32_t a, uint32_t b)
+	{
+		a = FindRoot(parents, a);
+		b = FindRoot(parents, b);
+		if (a != b)
+		{
+			parents[std::max(a, b)] = std::min(a, b);
+		}
+	}
+} //namespace
+
+IslandTracker::IslandTracker(float voxelVolume, const std::string& reportFileName) :
+	voxelVolume_(voxelVolume),
+	nextId_(1),
+	islandsCount_(0),
+	unsupportedCount_(0),
+	firstLayer_(0)
+{
+	if (reportFileName.empty())
+	{
+		return;
+	}
+
+	report_.open(reportFileName, std::ios::out | std::ios::trunc);
+	if (!report_)
+		throw std::runtime_error("Can't create islands report file");
+
+	report_ << "island,birthLayer,lastLayer,mergedInto,volume,xBegin,yBegin,xEnd,yEnd\n";
+}
+
+// Nodes of union-find are islands of previous layer followed by components of current layer.
+void IslandTracker::AddLayer(uint32_t layer, std::shared_ptr<const RunRaster> runs)
+{
+	ASSERT(!previousRuns_ || (runs->GetWidth() == previousRuns_->GetWidth() && runs->GetHeight() == previousRuns_->GetHeight()));
+
+	if (!previousRuns_)
+	{
+		firstLayer_ = layer;
+	}
+
+	std::vector<uint32_t> runLabels;
+	std::vector<Segment> segments;
+	SegmentizeRuns(*runs, runLabels, segments);
+
+	const auto islandCount = static_cast<uint32_t>(islands_.size());
+	std::vector<uint32_t> parents(islandCount + segments.size());
+	for (size_t i = 0; i < parents.size(); ++i)
+	{
+		parents[i] = static_cast<uint32_t>(i);
+	}
+	LinkOverlappingRuns(*runs, runLabels, parents);
+
+	std::vector<bool> continued(islandCount);
+	for (size_t i = 0; i < segments.size(); ++i)
+	{
+		const auto root = FindRoot(parents, static_cast<uint32_t>(islandCount + i));
+		if (root < islandCount)
+		{
+			continued[root] = true;
+		}
+	}
+
+	// islands joining older ones & islands without components in this layer end, the rest keep their order
+	std::vector<TrackedIsland> islands;
+	std::vector<uint32_t> newIndices(islandCount);
+	for (uint32_t i = 0; i < islandCount; ++i)
+	{
+		auto& island = islands_[i];
+		const auto root = FindRoot(parents, i);
+		if (root != i)
+		{
+			island.mergedInto = islands_[root].id;
+			WriteIsland(island);
+		}
+		else if (!continued[i])
+		{
+			WriteIsland(island);
+		}
+		else
+		{
+			newIndices[i] = static_cast<uint32_t>(islands.size());
+			island.lastLayer = layer;
+			island.layerVolume = 0.0f;
+			islands.push_back(island);
+		}
+	}
+
+	std::vector<uint32_t> segmentIslands(segments.size());
+	for (size_t i = 0; i < segments.size(); ++i)
+	{
+		const auto& segment = segments[i];
+		const auto root = FindRoot(parents, static_cast<uint32_t>(islandCount + i));
+		if (root < islandCount)
+		{
+			segmentIslands[i] = newIndices[root];
+		}
+		else
+		{
+			// component is never united with another one of the same layer, so it's its own root
+			segmentIslands[i] = static_cast<uint32_t>(islands.size());
+			islands.push_back(TrackedIsland{ nextId_++, layer, layer, 0, 0.0f, 0.0f,
+				segment.xBegin, segment.yBegin, segment.xEnd, segment.yEnd });
+		}
+
+		auto& island = islands[segmentIslands[i]];
+		island.layerVolume += segment.coverage * voxelVolume_;
+		island.volume += segment.coverage * voxelVolume_;
+	}
+
+	islands_ = std::move(islands);
+	previousIslands_ = std::move(segmentIslands);
+	previousRunLabels_ = std::move(runLabels);
+	previousRuns_ = std::move(runs);
+}
+
+void IslandTracker::RepeatLayer(uint32_t layer)
+{
+	for (auto& island : islands_)
+	{
+		island.volume += island.layerVolume;
+		island.lastLayer = layer;
+	}
+}
+
+void IslandTracker::Finish()
+{
+	for (const auto& island : islands_)
+	{
+		WriteIsland(island);
+	}
+	islands_.clear();
+	previousIslands_.clear();
+	previousRunLabels_.clear();
+	previousRuns_.reset();
+
+	if (report_.is_open())
+	{
+		report_.close();
+		if (!report_)
+			throw std::runtime_error("Error during closing islands report file");
+	}
+
+	BOOST_LOG_TRIVIAL(info) << "Islands: " << islandsCount_ << ", born above the first layer: " << unsupportedCount_;
+}
+
+// Runs of the same row overlapping by at least one pixel link their components.
+void IslandTracker::LinkOverlappingRuns(const RunRaster& runs, const std::vector<uint32_t>& runLabels, std::vector<uint32_t>& parents) const
+{
+	if (!previousRuns_)
+	{
+		return;
+	}
+
+	const auto islandCount = static_cast<uint32_t>(islands_.size());
+	for (auto y = 0; y < runs.GetHeight(); ++y)
+	{
+		auto previous = previousRuns_->GetRowBegin(y);
+		const auto previousEnd = previousRuns_->GetRowEnd(y);
+		for (auto run = runs.GetRowBegin(y); run != runs.GetRowEnd(y) && previous != previousEnd; ++run)
+		{
+			for (; previous != previousEnd && previous->End() <= run->begin; ++previous)
+			{
+			}
+			// the last overlapping run may overlap the next run as well
+			for (auto overlapping = previous; overlapping != previousEnd && overlapping->begin < run->End(); ++overlapping)
+			{
+				const auto label = runLabels[runs.GetRunIndex(run)];
+				const auto previousLabel = previousRunLabels_[previousRuns_->GetRunIndex(overlapping)];
+				if (label != 0 && previousLabel != 0)
+				{
+					Unite(parents, previousIslands_[previousLabel - 1], islandCount + label - 1);
+				}
+			}
+		}
+	}
+}
+
+void IslandTracker::WriteIsland(const TrackedIsland& island)
+{
+	++islandsCount_;
+	if (island.birthLayer != firstLayer_)
+	{
+		++unsupportedCount_;
+	}
+
+	if (!report_.is_open())
+	{
+		return;
+	}
+
+	report_ << island.id << ',' << island.birthLayer << ',' << island.lastLayer << ',' << island.mergedInto << ',' << island.volume << ','
+		<< island.xBegin << ',' << island.yBegin << ',' << island.xEnd << ',' << island.yEnd << '\n';
+	if (!report_)
+		throw std::runtime_error("Error during writing islands report file");
+}
\ No newline at end of file
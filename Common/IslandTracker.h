@@ -0,0 +1,71 @@
+#pragma once
+
+#include "RunRaster.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Part of model growing through consecutive layers from the layer where it has no overlap with previous one.
+struct TrackedIsland
+{
+	uint32_t id;
+	uint32_t birthLayer;
+	uint32_t lastLayer;
+	// older island it has joined, 0 - it has ended by itself
+	uint32_t mergedInto;
+	// mm^3
+	float volume;
+	// volume of its sections in the last layer
+	float layerVolume;
+	// bounding box of birth section (pixels)
+	int xBegin, yBegin;
+	int xEnd, yEnd;
+};
+
+// Streaming 3D labelling of layers: components of each layer are linked by union-find to components
+// of previous layer they overlap, so only previous layer runs & labels are kept regardless of job height.
+// Component without overlap gives birth to new island (the first layer ones stand on platform).
+// Island ends when none of its components continue, or when it joins older island in the same component.
+// Report is CSV with line per island written when it ends: island, birth layer, last layer, merged into & volume
+// with bounding box of birth section.
+class IslandTracker
+{
+public:
+	// voxelVolume: pixel area times layer thickness (mm^3)
+	// reportFileName: empty - islands are only counted
+	IslandTracker(float voxelVolume, const std::string& reportFileName);
+
+	// Layers are added in order, layer is slice number (consecutive ones differ by one layer thickness),
+	// so birth & last layers of islands are slice numbers too.
+	void AddLayer(uint32_t layer, std::shared_ptr<const RunRaster> runs);
+	// layer is the same as the previous one
+	void RepeatLayer(uint32_t layer);
+	// ends islands of the last layer & closes report
+	void Finish();
+
+private:
+	IslandTracker(const IslandTracker&) = delete;
+	IslandTracker& operator=(const IslandTracker&) = delete;
+
+	void LinkOverlappingRuns(const RunRaster& runs, const std::vector<uint32_t>& runLabels, std::vector<uint32_t>& parents) const;
+	void WriteIsland(const TrackedIsland& island);
+
+	const float voxelVolume_;
+
+	std::shared_ptr<const RunRaster> previousRuns_;
+	std::vector<uint32_t> previousRunLabels_;
+	// index in islands_ of each component of previous layer
+	std::vector<uint32_t> previousIslands_;
+	// islands of previous layer, ordered by id (so by age)
+	std::vector<TrackedIsland> islands_;
+	uint32_t nextId_;
+
+	std::ofstream report_;
+	size_t islandsCount_;
+	size_t unsupportedCount_;
+	uint32_t firstLayer_;
+};
\ No newline at end of file
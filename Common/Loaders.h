@@ -15,6 +15,7 @@ FileType GetFileType(const std::string& file);
 
 void LoadStl(const std::string& file, std::vector<float>& vb, std::vector<uint32_t>& ib);
 void LoadObj(const std::string& file, std::vector<float>& vb, std::vector<uint32_t>& ib);
+void LoadMesh(const std::string& file, std::vector<float>& vb, std::vector<uint32_t>& ib);
 
 void LoadModel(const std::string& file, const std::function<void(
 	const std::vector<float>&, const std::vector<float>&, const std::vector<uint16_t>&)>& onMesh);
\ No newline at end of file
@@ -0,0 +1,184 @@
+#include "MeshSlicer.h"
+#include "ErrorHandling.h"
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace
+{
+	uint64_t GetEdgeId(uint32_t v0, uint32_t v1)
+	{
+		return (static_cast<uint64_t>(std::min(v0, v1)) << 32) | std::max(v0, v1);
+	}
+} //namespace
+
+MeshSlicer::MeshSlicer(const std::vector<float>& vb, const std::vector<uint32_t>& ib) :
+	nextTriangle_(0),
+	currentZ_(std::numeric_limits<float>::lowest()),
+	sameAsPrevious_(false),
+	min_(std::numeric_limits<float>::max()),
+	max_(std::numeric_limits<float>::lowest())
+{
+	EXPECT(vb.size() % 3 == 0 && ib.size() % 3 == 0);
+
+	vertices_.reserve(vb.size() / 3);
+	for (size_t i = 0; i < vb.size(); i += 3)
+	{
+		vertices_.emplace_back(vb[i + 0], vb[i + 1], vb[i + 2]);
+		min_ = glm::min(min_, vertices_.back());
+		max_ = glm::max(max_, vertices_.back());
+	}
+
+	triangles_.reserve(ib.size() / 3);
+	for (size_t i = 0; i < ib.size(); i += 3)
+	{
+		triangles_.push_back(Triangle{ { ib[i + 0], ib[i + 1], ib[i + 2] } });
+	}
+
+	std::sort(triangles_.begin(), triangles_.end(), [this](const Triangle& a, const Triangle& b) {
+		return GetZMin(a) < GetZMin(b);
+	});
+}
+
+float MeshSlicer::GetZMin(const Triangle& t) const
+{
+	return std::min(std::min(vertices_[t.v[0]].z, vertices_[t.v[1]].z), vertices_[t.v[2]].z);
+}
+
+float MeshSlicer::GetZMax(const Triangle& t) const
+{
+	return std::max(std::max(vertices_[t.v[0]].z, vertices_[t.v[1]].z), vertices_[t.v[2]].z);
+}
+
+// Returns true when active triangles set has not changed.
+bool MeshSlicer::UpdateActiveTriangles(float z)
+{
+	const auto previousCount = activeTriangles_.size();
+	const auto previousNext = nextTriangle_;
+	if (z < currentZ_)
+	{
+		activeTriangles_.clear();
+		nextTriangle_ = 0;
+	}
+	currentZ_ = z;
+
+	activeTriangles_.erase(std::remove_if(activeTriangles_.begin(), activeTriangles_.end(), [this, z](uint32_t index) {
+		return GetZMax(triangles_[index]) <= z;
+	}), activeTriangles_.end());
+
+	for (; nextTriangle_ < triangles_.size() && GetZMin(triangles_[nextTriangle_]) <= z; ++nextTriangle_)
+	{
+		if (GetZMax(triangles_[nextTriangle_]) > z)
+		{
+			activeTriangles_.push_back(static_cast<uint32_t>(nextTriangle_));
+		}
+	}
+
+	// removal keeps order, so unchanged set has the same count & no new triangles
+	return activeTriangles_.size() == previousCount && nextTriangle_ == previousNext;
+}
+
+// Intersection is calculated in the same vertex order for both faces sharing edge,
+// so adjacent cross section edges meet exactly.
+glm::vec2 MeshSlicer::IntersectEdge(uint32_t v0, uint32_t v1, float z) const
+{
+	const auto& a = vertices_[std::min(v0, v1)];
+	const auto& b = vertices_[std::max(v0, v1)];
+	const auto t = (z - a.z) / (b.z - a.z);
+	return glm::vec2(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t);
+}
+
+void MeshSlicer::Slice(float z, std::vector<SliceEdge>& edges)
+{
+	const bool sameTriangles = UpdateActiveTriangles(z);
+
+	edges.clear();
+	edges.reserve(activeTriangles_.size());
+	for (const auto index : activeTriangles_)
+	{
+		const auto& triangle = triangles_[index];
+
+		// Vertex lying on plane counts as below it, so active triangle
+		// always has exactly one edge going down & one going up through the plane.
+		SliceEdge edge;
+		for (auto i = 0; i < 3; ++i)
+		{
+			const auto v0 = triangle.v[i];
+			const auto v1 = triangle.v[(i + 1) % 3];
+			const bool above0 = vertices_[v0].z > z;
+			const bool above1 = vertices_[v1].z > z;
+			if (above0 && !above1)
+			{
+				edge.from = IntersectEdge(v0, v1, z);
+				edge.fromId = GetEdgeId(v0, v1);
+			}
+			else if (!above0 && above1)
+			{
+				edge.to = IntersectEdge(v0, v1, z);
+				edge.toId = GetEdgeId(v0, v1);
+			}
+		}
+		edges.push_back(edge);
+	}
+
+	// triangles are in the same order, so edges can be compared one by one
+	sameAsPrevious_ = sameTriangles && !previousEdges_.empty() && edges.size() == previousEdges_.size() &&
+		std::equal(edges.begin(), edges.end(), previousEdges_.begin(),
+			[](const SliceEdge& a, const SliceEdge& b) { return a.from == b.from && a.to == b.to; });
+	previousEdges_ = edges;
+}
+
+void ChainContours(const std::vector<SliceEdge>& edges, std::vector<Contour>& contours)
+{
+	contours.clear();
+
+	std::unordered_map<uint64_t, size_t> edgeByStart(edges.size());
+	std::unordered_set<uint64_t> ends(edges.size());
+	for (size_t i = 0; i < edges.size(); ++i)
+	{
+		edgeByStart.emplace(edges[i].fromId, i);
+		ends.insert(edges[i].toId);
+	}
+
+	std::vector<bool> used(edges.size(), false);
+	const auto chain = [&](size_t first) {
+		Contour contour;
+		contour.points.push_back(edges[first].from);
+		for (auto current = first;;)
+		{
+			used[current] = true;
+			const auto next = edgeByStart.find(edges[current].toId);
+			if (next == edgeByStart.end() || used[next->second])
+			{
+				contour.closed = next != edgeByStart.end() && next->second == first;
+				if (!contour.closed)
+				{
+					contour.points.push_back(edges[current].to);
+				}
+				break;
+			}
+			contour.points.push_back(edges[current].to);
+			current = next->second;
+		}
+		contours.push_back(std::move(contour));
+	};
+
+	// open chains first, so they are not split in the middle
+	for (size_t i = 0; i < edges.size(); ++i)
+	{
+		if (!used[i] && ends.find(edges[i].fromId) == ends.end())
+		{
+			chain(i);
+		}
+	}
+
+	for (size_t i = 0; i < edges.size(); ++i)
+	{
+		if (!used[i])
+		{
+			chain(i);
+		}
+	}
+}
\ No newline at end of file
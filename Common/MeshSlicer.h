@@ -0,0 +1,69 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+struct SliceEdge
+{
+	glm::vec2 from;
+	glm::vec2 to;
+	// mesh edges crossed at from & to points
+	uint64_t fromId;
+	uint64_t toId;
+};
+
+struct Contour
+{
+	std::vector<glm::vec2> points;
+	bool closed = false;
+};
+
+// Links cross section edges sharing mesh edge into contours (orientation is kept).
+// Chains broken by mesh defects are returned as open contours.
+void ChainContours(const std::vector<SliceEdge>& edges, std::vector<Contour>& contours);
+
+// Cuts triangle mesh by horizontal planes.
+// Triangles crossing current plane are tracked incrementally, so slicing
+// with non-decreasing z visits each triangle only while it is active.
+class MeshSlicer
+{
+public:
+	MeshSlicer(const std::vector<float>& vb, const std::vector<uint32_t>& ib);
+
+	// Cross section edges are oriented with material on the left (for consistently wound mesh).
+	void Slice(float z, std::vector<SliceEdge>& edges);
+
+	// True when last sliced cross section is identical to previous one:
+	// no triangle entered or left the plane & all crossing points are the same
+	// (e.g. extrusion-like parts with vertical walls).
+	bool IsSameAsPrevious() const { return sameAsPrevious_; }
+
+	glm::vec3 GetMin() const { return min_; }
+	glm::vec3 GetMax() const { return max_; }
+
+private:
+	struct Triangle
+	{
+		uint32_t v[3];
+	};
+
+	float GetZMin(const Triangle& t) const;
+	float GetZMax(const Triangle& t) const;
+	bool UpdateActiveTriangles(float z);
+	glm::vec2 IntersectEdge(uint32_t v0, uint32_t v1, float z) const;
+
+	std::vector<glm::vec3> vertices_;
+	std::vector<Triangle> triangles_;
+	std::vector<uint32_t> activeTriangles_;
+	size_t nextTriangle_;
+	float currentZ_;
+
+	std::vector<SliceEdge> previousEdges_;
+	bool sameAsPrevious_;
+
+	glm::vec3 min_;
+	glm::vec3 max_;
+};
\ No newline at end of file
@@ -0,0 +1,282 @@
+#include "OverhangAnalyzer.h"
+
+#include "RasterKernels.h"
+
+#include <ErrorHandling.h>
+
+#include <boost/log/trivial.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+	// Layers are tracked in order: action waits for tracking of previous layer.
+	template <typename Action>
+	void TrackInOrder(const std::shared_future<void>& previous, std::promise<void>& tracked, const Action& action)
+	{
+		try
+		{
+			if (previous.valid())
+			{
+				previous.get();
+			}
+			action();
+			tracked.set_value();
+		}
+		catch (...)
+		{
+			tracked.set_exception(std::current_exception());
+			throw;
+		}
+	}
+} //namespace
+
+OverhangAnalyzer::OverhangAnalyzer(int width, int height, float supportRadius, bool circleKernel, float pixelArea, float layerThickness,
+	const std::string& reportFileName, const std::string& islandsReportFileName) :
+	width_(width),
+	height_(height),
+	supportRadius_(supportRadius),
+	circleKernel_(circleKernel),
+	pixelArea_(pixelArea),
+	maxLayersInFlight_(std::max(1u, std::thread::hardware_concurrency())),
+	tracker_(pixelArea * layerThickness, islandsReportFileName),
+	layersWithOverhangs_(0),
+	islandsCount_(0)
+{
+	if (reportFileName.empty())
+	{
+		return;
+	}
+
+	report_.open(reportFileName, std::ios::out | std::ios::trunc);
+	if (!report_)
+		throw std::runtime_error("Can't create overhangs report file");
+
+	report_ << "layer,island,pixels,area,centerX,centerY,xBegin,yBegin,xEnd,yEnd\n";
+}
+
+void OverhangAnalyzer::AddLayer(uint32_t layer, std::shared_ptr<const std::vector<uint8_t>> raster, const RasterRect& rect)
+{
+	ASSERT(raster->size() == static_cast<size_t>(width_) * height_);
+
+	// next layer waits for dilation only, so it's published before analysis of this one
+	auto support = std::make_shared<std::promise<Support>>();
+	const auto previousSupport = support_;
+	support_ = support->get_future().share();
+
+	auto tracked = std::make_shared<std::promise<void>>();
+	const auto previousTracked = tracked_;
+	tracked_ = tracked->get_future().share();
+
+	PushLayer(layer, std::async(std::launch::async, [this, layer, raster, rect, support, previousSupport, tracked, previousTracked]() {
+		std::shared_ptr<const RunRaster> runs;
+		try
+		{
+			runs = std::make_shared<const RunRaster>(*raster, width_, height_, rect);
+			support->set_value(CalculateSupport(*runs, *raster, rect));
+		}
+		catch (...)
+		{
+			support->set_exception(std::current_exception());
+			throw;
+		}
+
+		std::vector<OverhangIsland> islands;
+		if (previousSupport.valid())
+		{
+			islands = FindIslands(SubtractSupport(*runs, *raster, rect, previousSupport.get()));
+		}
+
+		TrackInOrder(previousTracked, *tracked, [this, layer, runs]() { tracker_.AddLayer(layer, runs); });
+		return islands;
+	}));
+}
+
+// Support isn't calculated, so layers don't wait for each other except for tracking.
+void OverhangAnalyzer::AddLayer(uint32_t layer, std::shared_ptr<const std::vector<uint8_t>> raster, const RasterRect& rect,
+	std::shared_ptr<const std::vector<uint8_t>> overhangs)
+{
+	ASSERT(raster->size() == static_cast<size_t>(width_) * height_);
+	ASSERT(overhangs->size() == raster->size());
+
+	auto tracked = std::make_shared<std::promise<void>>();
+	const auto previousTracked = tracked_;
+	tracked_ = tracked->get_future().share();
+
+	PushLayer(layer, std::async(std::launch::async, [this, layer, raster, rect, overhangs, tracked, previousTracked]() {
+		std::shared_ptr<const RunRaster> runs;
+		std::vector<OverhangIsland> islands;
+		try
+		{
+			runs = std::make_shared<const RunRaster>(*raster, width_, height_, rect);
+			auto thresholded = *overhangs;
+			islands = FindIslands(ThresholdOverhangs(thresholded, rect));
+		}
+		catch (...)
+		{
+			tracked->set_exception(std::current_exception());
+			throw;
+		}
+
+		TrackInOrder(previousTracked, *tracked, [this, layer, runs]() { tracker_.AddLayer(layer, runs); });
+		return islands;
+	}));
+}
+
+// Support of the next layer stays the same.
+void OverhangAnalyzer::RepeatLayer(uint32_t layer)
+{
+	ASSERT(tracked_.valid());
+
+	auto tracked = std::make_shared<std::promise<void>>();
+	const auto previousTracked = tracked_;
+	tracked_ = tracked->get_future().share();
+
+	PushLayer(layer, std::async(std::launch::async, [this, layer, tracked, previousTracked]() {
+		TrackInOrder(previousTracked, *tracked, [this, layer]() { tracker_.RepeatLayer(layer); });
+		return std::vector<OverhangIsland>();
+	}));
+}
+
+void OverhangAnalyzer::Finish()
+{
+	while (!layers_.empty())
+	{
+		WriteLayer(layers_.front());
+		layers_.pop_front();
+	}
+	tracker_.Finish();
+
+	if (report_.is_open())
+	{
+		report_.close();
+		if (!report_)
+			throw std::runtime_error("Error during closing overhangs report file");
+	}
+
+	BOOST_LOG_TRIVIAL(info) << "Layers with overhangs: " << layersWithOverhangs_ << ", overhang islands: " << islandsCount_;
+}
+
+// Square support is binary dilation of runs, circle one is antialiased dilation of image.
+OverhangAnalyzer::Support OverhangAnalyzer::CalculateSupport(const RunRaster& runs, const std::vector<uint8_t>& raster,
+	const RasterRect& rect) const
+{
+	if (!circleKernel_)
+	{
+		return Support{ std::make_shared<const RunRaster>(DilateSquare(runs, static_cast<int>(std::ceil(supportRadius_)))), nullptr };
+	}
+
+	auto dilated = std::make_shared<std::vector<uint8_t>>();
+	DilateCircle(raster, *dilated, width_, height_, supportRadius_, FindLitRect(raster, width_, height_, rect));
+	return Support{ nullptr, dilated };
+}
+
+// Pixels of layer without support (GPU layer difference), antialiased support is subtracted by row kernels,
+// so only pixels it doesn't touch at all stay fully covered.
+RunRaster OverhangAnalyzer::SubtractSupport(const RunRaster& runs, const std::vector<uint8_t>& raster, const RasterRect& rect,
+	const Support& support) const
+{
+	if (support.runs)
+	{
+		return Difference(runs, *support.runs);
+	}
+
+	const auto columns = static_cast<size_t>(std::max(rect.xEnd - rect.xBegin, 0));
+	std::vector<uint8_t> overhangs(raster.size());
+	for (auto y = rect.yBegin; y < rect.yEnd; ++y)
+	{
+		const auto offset = static_cast<size_t>(y) * width_ + rect.xBegin;
+		SubtractRows(&raster[offset], &(*support.pixels)[offset], &overhangs[offset], columns);
+	}
+	return ThresholdOverhangs(overhangs, rect);
+}
+
+// Only fully covered pixels of difference are kept, so partially supported ones never become overhangs.
+RunRaster OverhangAnalyzer::ThresholdOverhangs(std::vector<uint8_t>& overhangs, const RasterRect& rect) const
+{
+	const uint8_t FullCoverage = 255;
+	const auto columns = static_cast<size_t>(std::max(rect.xEnd - rect.xBegin, 0));
+	for (auto y = rect.yBegin; y < rect.yEnd; ++y)
+	{
+		const auto offset = static_cast<size_t>(y) * width_ + rect.xBegin;
+		ThresholdRow(&overhangs[offset], &overhangs[offset], columns, FullCoverage);
+	}
+	return RunRaster(overhangs, width_, height_, rect);
+}
+
+// Only fully covered pixels are counted, so partially covered edge of layer is never an overhang.
+std::vector<OverhangIsland> OverhangAnalyzer::FindIslands(const RunRaster& overhangs) const
+{
+	const uint8_t FullCoverage = 255;
+
+	std::vector<uint32_t> runLabels;
+	std::vector<Segment> segments;
+	SegmentizeRuns(overhangs, runLabels, segments, FullCoverage);
+
+	// sums of pixel centers
+	std::vector<double> sumsX(segments.size()), sumsY(segments.size());
+	for (auto y = 0; y < overhangs.GetHeight(); ++y)
+	{
+		for (auto run = overhangs.GetRowBegin(y); run != overhangs.GetRowEnd(y); ++run)
+		{
+			const auto label = runLabels[overhangs.GetRunIndex(run)];
+			if (label != 0)
+			{
+				sumsX[label - 1] += 0.5 * run->length * (run->begin + run->End());
+				sumsY[label - 1] += run->length * (y + 0.5);
+			}
+		}
+	}
+
+	std::vector<OverhangIsland> islands;
+	islands.reserve(segments.size());
+	for (size_t i = 0; i < segments.size(); ++i)
+	{
+		const auto& segment = segments[i];
+		islands.push_back(OverhangIsland{ segment.count, segment.count * pixelArea_,
+			static_cast<float>(sumsX[i] / segment.count), static_cast<float>(sumsY[i] / segment.count),
+			segment.xBegin, segment.yBegin, segment.xEnd, segment.yEnd });
+	}
+	return islands;
+}
+
+void OverhangAnalyzer::PushLayer(uint32_t layer, std::future<std::vector<OverhangIsland>> islands)
+{
+	layers_.push_back(LayerResult{ layer, std::move(islands) });
+	while (layers_.size() > maxLayersInFlight_)
+	{
+		WriteLayer(layers_.front());
+		layers_.pop_front();
+	}
+}
+
+void OverhangAnalyzer::WriteLayer(LayerResult& result)
+{
+	const auto islands = result.islands.get();
+	if (islands.empty())
+	{
+		return;
+	}
+
+	++layersWithOverhangs_;
+	islandsCount_ += islands.size();
+	BOOST_LOG_TRIVIAL(info) << "Overhangs at layer " << result.layer << ": " << islands.size() << " islands";
+
+	if (!report_.is_open())
+	{
+		return;
+	}
+
+	for (size_t i = 0; i < islands.size(); ++i)
+	{
+		const auto& island = islands[i];
+		report_ << result.layer << ',' << i + 1 << ',' << island.pixels << ',' << island.area << ','
+			<< island.centerX << ',' << island.centerY << ','
+			<< island.xBegin << ',' << island.yBegin << ',' << island.xEnd << ',' << island.yEnd << '\n';
+	}
+	if (!report_)
+		throw std::runtime_error("Error during writing overhangs report file");
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "RunRaster.h"
+#include "Raster.h"
+#include "IslandTracker.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Connected part of layer which is farther than support distance from material of previous layer.
+struct OverhangIsland
+{
+	uint32_t pixels;
+	// mm^2
+	float area;
+	// image pixels, row 0 is the first one of saved image
+	float centerX, centerY;
+	int xBegin, yBegin;
+	int xEnd, yEnd;
+};
+
+// Overhangs analysis on CPU: each layer is kept as runs, previous layer is dilated by support kernel
+// & 8-connected islands of fully covered pixels outside of it are reported.
+// Layer is dilated as soon as it's added, so layers are analyzed in parallel & only report is written in order.
+// Difference against support may be rendered on GPU as well, then it's only labelled.
+// Report is CSV with line per island: layer, island, pixels, area, centroid & bounding box.
+// Layers are passed to IslandTracker one by one as well, so births of islands are found in the same pass.
+class OverhangAnalyzer
+{
+public:
+	// supportRadius: pixels, circleKernel - euclidean distance instead of square around pixel
+	// layerThickness: mm, for island volumes
+	// report file names: empty - islands are only counted
+	OverhangAnalyzer(int width, int height, float supportRadius, bool circleKernel, float pixelArea, float layerThickness,
+		const std::string& reportFileName, const std::string& islandsReportFileName);
+
+	// Layers are added in order, the first one stands on platform. Pixels outside of rect should be black.
+	void AddLayer(uint32_t layer, std::shared_ptr<const std::vector<uint8_t>> raster, const RasterRect& rect);
+	// Same, support is subtracted elsewhere (GPU): overhangs are layer minus support of previous layer.
+	void AddLayer(uint32_t layer, std::shared_ptr<const std::vector<uint8_t>> raster, const RasterRect& rect,
+		std::shared_ptr<const std::vector<uint8_t>> overhangs);
+	// layer is identical to the previous one, so it has no overhangs
+	void RepeatLayer(uint32_t layer);
+	// waits for added layers & closes reports
+	void Finish();
+
+private:
+	OverhangAnalyzer(const OverhangAnalyzer&) = delete;
+	OverhangAnalyzer& operator=(const OverhangAnalyzer&) = delete;
+
+	// Square support is kept as runs, antialiased circle one as pixels.
+	struct Support
+	{
+		std::shared_ptr<const RunRaster> runs;
+		std::shared_ptr<const std::vector<uint8_t>> pixels;
+	};
+
+	using SupportFuture = std::shared_future<Support>;
+	using TrackingFuture = std::shared_future<void>;
+
+	struct LayerResult
+	{
+		uint32_t layer;
+		std::future<std::vector<OverhangIsland>> islands;
+	};
+
+	Support CalculateSupport(const RunRaster& runs, const std::vector<uint8_t>& raster, const RasterRect& rect) const;
+	RunRaster SubtractSupport(const RunRaster& runs, const std::vector<uint8_t>& raster, const RasterRect& rect, const Support& support) const;
+	RunRaster ThresholdOverhangs(std::vector<uint8_t>& overhangs, const RasterRect& rect) const;
+	std::vector<OverhangIsland> FindIslands(const RunRaster& overhangs) const;
+	void WriteLayer(LayerResult& result);
+	void PushLayer(uint32_t layer, std::future<std::vector<OverhangIsland>> islands);
+
+	const int width_;
+	const int height_;
+	const float supportRadius_;
+	const bool circleKernel_;
+	const float pixelArea_;
+	const size_t maxLayersInFlight_;
+
+	// dilation of the last added layer
+	SupportFuture support_;
+	// tracking of the last added layer, tracker is busy until it's ready
+	TrackingFuture tracked_;
+	IslandTracker tracker_;
+	std::deque<LayerResult> layers_;
+
+	std::ofstream report_;
+	size_t layersWithOverhangs_;
+	size_t islandsCount_;
+};
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include <png.h>
 #include <stdexcept>
+#include <memory>
+#include <algorithm>
 
 std::vector<uint32_t> CreateGrayscalePalette()
 {
@@ -13,36 +15,32 @@ std::vector<uint32_t> CreateGrayscalePalette()
 	return palette;
 }
 
-std::vector<uint8_t> ReadPng(const std::string& fileName, uint32_t& width, uint32_t& height, uint32_t& bitsPerPixel)
+namespace
 {
-	FILE* fp = nullptr;
-	png_structp png_ptr = nullptr;
-	png_infop info_ptr = nullptr;
-
-	try
+	// Released by destructor, so longjmp targets below don't own anything.
+	struct PngReadState
 	{
-		unsigned char header[8];    // 8 is the maximum size that can be checked
-
-		/* open file and test for it being a png */
-		fp = fopen(fileName.c_str(), "rb");
-		if (!fp)
-			throw std::runtime_error("PNG file could not be opened for reading");
-
-		fread(header, 1, sizeof(header), fp);
-		if (png_sig_cmp(header, 0, 8))
-			throw std::runtime_error("File is not recognized as a PNG file");
-
-
-		/* initialize stuff */
-		png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+		~PngReadState()
+		{
+			if (png_ptr || info_ptr)
+			{
+				png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+			}
 
-		if (!png_ptr)
-			throw std::runtime_error("png_create_read_struct failed");
+			if (fp)
+			{
+				fclose(fp);
+			}
+		}
 
-		info_ptr = png_create_info_struct(png_ptr);
-		if (!info_ptr)
-			throw std::runtime_error("png_create_info_struct failed");
+		FILE* fp = nullptr;
+		png_structp png_ptr = nullptr;
+		png_infop info_ptr = nullptr;
+	};
 
+	// setjmp is kept in functions without C++ objects & variables changed after it
+	void ReadInfo(png_structp png_ptr, png_infop info_ptr, FILE* fp)
+	{
 		if (setjmp(png_jmpbuf(png_ptr)))
 			throw std::runtime_error("Error during init_io");
 
@@ -51,175 +49,306 @@ std::vector<uint8_t> ReadPng(const std::string& fileName, uint32_t& width, uint3
 
 		png_read_info(png_ptr, info_ptr);
 
-		auto png_width = png_get_image_width(png_ptr, info_ptr);
-		auto png_height = png_get_image_height(png_ptr, info_ptr);
-		auto color_type = png_get_color_type(png_ptr, info_ptr);
-		auto channel_depth = png_get_bit_depth(png_ptr, info_ptr);
-
 		/*auto number_of_passes = */png_set_interlace_handling(png_ptr);
 		png_read_update_info(png_ptr, info_ptr);
+	}
 
+	void ReadImage(png_structp png_ptr, png_bytepp rowPointers)
+	{
 		/* read file */
 		if (setjmp(png_jmpbuf(png_ptr)))
 			throw std::runtime_error("Error during read_image");
 
-		auto channels = 0;
-		switch (color_type)
-		{
-		case PNG_COLOR_TYPE_RGB:
-			channels = 3;
-			break;
-		case PNG_COLOR_TYPE_RGBA:
-			channels = 4;
-			break;
-		default:
-			throw std::runtime_error("PNG reader: can only read RGB or RGBA files");
-		}
+		png_read_image(png_ptr, rowPointers);
+	}
+} //namespace
 
-		std::vector<uint8_t> data;
-		std::vector<uint8_t*> rowPointers;
+std::vector<uint8_t> ReadPng(const std::string& fileName, uint32_t& width, uint32_t& height, uint32_t& bitsPerPixel)
+{
+	PngReadState state;
+	unsigned char header[8];    // 8 is the maximum size that can be checked
 
-		const auto pixelRowByteSize = png_width * channel_depth * channels / 8;
-		data.resize(pixelRowByteSize * png_height);
-		rowPointers.resize(png_height);
-		for (auto y = 0u; y < png_height; ++y)
-		{
-			rowPointers[y] = &data[0] + y * pixelRowByteSize;
-		}
+	/* open file and test for it being a png */
+	state.fp = fopen(fileName.c_str(), "rb");
+	if (!state.fp)
+		throw std::runtime_error("PNG file could not be opened for reading");
+
+	if (fread(header, 1, sizeof(header), state.fp) != sizeof(header) || png_sig_cmp(header, 0, 8))
+		throw std::runtime_error("File is not recognized as a PNG file");
 
-		png_read_image(png_ptr, &rowPointers[0]);
-		fclose(fp);
-		fp = nullptr;
 
-		width = png_width;
-		height = png_height;
-		bitsPerPixel = channel_depth * channels;
-		return data;
+	/* initialize stuff */
+	state.png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+
+	if (!state.png_ptr)
+		throw std::runtime_error("png_create_read_struct failed");
+
+	state.info_ptr = png_create_info_struct(state.png_ptr);
+	if (!state.info_ptr)
+		throw std::runtime_error("png_create_info_struct failed");
+
+	ReadInfo(state.png_ptr, state.info_ptr, state.fp);
+
+	const auto png_width = png_get_image_width(state.png_ptr, state.info_ptr);
+	const auto png_height = png_get_image_height(state.png_ptr, state.info_ptr);
+	const auto color_type = png_get_color_type(state.png_ptr, state.info_ptr);
+	const auto channel_depth = png_get_bit_depth(state.png_ptr, state.info_ptr);
+
+	auto channels = 0;
+	switch (color_type)
+	{
+	case PNG_COLOR_TYPE_RGB:
+		channels = 3;
+		break;
+	case PNG_COLOR_TYPE_RGBA:
+		channels = 4;
+		break;
+	default:
+		throw std::runtime_error("PNG reader: can only read RGB or RGBA files");
 	}
-	catch (const std::exception&)
+
+	const auto pixelRowByteSize = png_width * channel_depth * channels / 8;
+	std::vector<uint8_t> data(pixelRowByteSize * png_height);
+	std::vector<uint8_t*> rowPointers(png_height);
+	for (auto y = 0u; y < png_height; ++y)
 	{
-		if (fp)
-		{
-			fclose(fp);
-		}
+		rowPointers[y] = &data[0] + y * pixelRowByteSize;
+	}
+
+	ReadImage(state.png_ptr, &rowPointers[0]);
 
+	width = png_width;
+	height = png_height;
+	bitsPerPixel = channel_depth * channels;
+	return data;
+}
+
+struct PngWriter::State
+{
+	~State()
+	{
 		if (png_ptr || info_ptr)
 		{
 			png_destroy_write_struct(&png_ptr, &info_ptr);
 		}
 
-		throw;
+		if (fp)
+		{
+			fclose(fp);
+		}
 	}
-}
 
-void WritePng(const std::string& fileName, uint32_t width, uint32_t height, uint32_t bitsPerChannel,
-	const std::vector<uint8_t>& pixData, const std::vector<uint32_t>& palette)
-{
-	FILE *fp = nullptr;
+	static void WriteToMemory(png_structp png_ptr, png_bytep data, png_size_t length)
+	{
+		auto output = static_cast<std::vector<uint8_t>*>(png_get_io_ptr(png_ptr));
+		output->insert(output->end(), data, data + length);
+	}
+
+	static void FlushMemory(png_structp)
+	{
+	}
+
+	FILE* fp = nullptr;
 	png_structp png_ptr = nullptr;
 	png_infop info_ptr = nullptr;
-	try
-	{
-		/* create file */
-		fp = fopen(fileName.c_str(), "wb");
-		if (!fp)
-			throw std::runtime_error("Can't create png file");
+};
+
+PngWriter::PngWriter(const std::string& fileName, uint32_t width, uint32_t height, uint32_t bitsPerChannel, uint32_t channels,
+	const std::vector<uint32_t>& palette, size_t compressionBufferSize) :
+	state_(new State()),
+	height_(height),
+	rowBytes_(width * channels * bitsPerChannel / 8),
+	rowsWritten_(0)
+{
+	/* create file */
+	state_->fp = fopen(fileName.c_str(), "wb");
+	if (!state_->fp)
+		throw std::runtime_error("Can't create png file");
 
-		/* initialize stuff */
-		png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-		if (!png_ptr)
-			throw std::runtime_error("png_create_write_struct failed");
+	Create(width, height, bitsPerChannel, channels, palette, compressionBufferSize, nullptr);
+}
 
-		info_ptr = png_create_info_struct(png_ptr);
-		if (!info_ptr)
-			throw std::runtime_error("png_create_info_struct failed");
+PngWriter::PngWriter(std::vector<uint8_t>& output, uint32_t width, uint32_t height, uint32_t bitsPerChannel, uint32_t channels,
+	const std::vector<uint32_t>& palette, size_t compressionBufferSize) :
+	state_(new State()),
+	height_(height),
+	rowBytes_(width * channels * bitsPerChannel / 8),
+	rowsWritten_(0)
+{
+	Create(width, height, bitsPerChannel, channels, palette, compressionBufferSize, &output);
+}
 
-		if (setjmp(png_jmpbuf(png_ptr)))
-			throw std::runtime_error("Error during init_io");
+void PngWriter::Create(uint32_t width, uint32_t height, uint32_t bitsPerChannel, uint32_t channels,
+	const std::vector<uint32_t>& palette, size_t compressionBufferSize, std::vector<uint8_t>* output)
+{
+	auto& state = *state_;
 
-		png_init_io(png_ptr, fp);
+	/* initialize stuff */
+	state.png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if (!state.png_ptr)
+		throw std::runtime_error("png_create_write_struct failed");
 
-		/* write header */
-		if (setjmp(png_jmpbuf(png_ptr)))
-			throw std::runtime_error("Error during writing header");
+	state.info_ptr = png_create_info_struct(state.png_ptr);
+	if (!state.info_ptr)
+		throw std::runtime_error("png_create_info_struct failed");
 
-		auto nChannels = pixData.size() / (width * height);
-		auto color_type = 0;
-		switch (nChannels)
-		{
-		case 1:
-			color_type = palette.empty() ? PNG_COLOR_TYPE_GRAY : PNG_COLOR_TYPE_PALETTE;
-			break;
-		case 3:
-			color_type = PNG_COLOR_TYPE_RGB;
-			break;
-		case 4:
-			color_type = PNG_COLOR_TYPE_RGBA;
-			break;
-		default:
-			throw std::runtime_error("Can only write 1, 3 or 4 channel PNG");
-		}
+	if (setjmp(png_jmpbuf(state.png_ptr)))
+		throw std::runtime_error("Error during init_io");
 
-		if (color_type == PNG_COLOR_TYPE_PALETTE)
-		{
-			std::vector<png_color> pngPalette(palette.size());
-			for (size_t i = 0; i < palette.size(); ++i)
-			{
-				pngPalette[i].red = palette[i] & 0xFF;
-				pngPalette[i].green = (palette[i] >> 8) & 0xFF;
-				pngPalette[i].blue = (palette[i] >> 16) & 0xFF;
-			}
-			png_set_PLTE(png_ptr, info_ptr, &pngPalette[0], static_cast<int>(pngPalette.size()));
-		}
+	if (output)
+	{
+		png_set_write_fn(state.png_ptr, output, &State::WriteToMemory, &State::FlushMemory);
+	}
+	else
+	{
+		png_init_io(state.png_ptr, state.fp);
+	}
 
-		png_set_IHDR(png_ptr, info_ptr, width, height,
-			bitsPerChannel, color_type, PNG_INTERLACE_NONE,
-			PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
-		png_set_filter(png_ptr, 0, PNG_NO_FILTERS);
-		png_set_sRGB_gAMA_and_cHRM(png_ptr, info_ptr, PNG_sRGB_INTENT_PERCEPTUAL);
-
-		const auto DefaultCompressionLevel = 1;
-		png_set_compression_level(png_ptr, DefaultCompressionLevel);
-		// set large buffer to write whole image in single IDAT
-		// to workaround Perfactory PNG reader bug.
-		png_set_compression_buffer_size(png_ptr, pixData.size()); 
-		
-		png_write_info(png_ptr, info_ptr);
-
-		/* write bytes */
-		if (setjmp(png_jmpbuf(png_ptr)))
-			throw std::runtime_error("Error during writing bytes");
+	/* write header */
+	if (setjmp(png_jmpbuf(state.png_ptr)))
+		throw std::runtime_error("Error during writing header");
 
-		std::vector<const uint8_t*> row_pointers(height);
-		for (auto i = 0u; i < height; ++i)
+	auto color_type = 0;
+	switch (channels)
+	{
+	case 1:
+		color_type = palette.empty() ? PNG_COLOR_TYPE_GRAY : PNG_COLOR_TYPE_PALETTE;
+		break;
+	case 3:
+		color_type = PNG_COLOR_TYPE_RGB;
+		break;
+	case 4:
+		color_type = PNG_COLOR_TYPE_RGBA;
+		break;
+	default:
+		throw std::runtime_error("Can only write 1, 3 or 4 channel PNG");
+	}
+
+	if (color_type == PNG_COLOR_TYPE_PALETTE)
+	{
+		std::vector<png_color> pngPalette(palette.size());
+		for (size_t i = 0; i < palette.size(); ++i)
 		{
-			row_pointers[i] = &pixData[width * nChannels * i];
+			pngPalette[i].red = palette[i] & 0xFF;
+			pngPalette[i].green = (palette[i] >> 8) & 0xFF;
+			pngPalette[i].blue = (palette[i] >> 16) & 0xFF;
 		}
+		png_set_PLTE(state.png_ptr, state.info_ptr, &pngPalette[0], static_cast<int>(pngPalette.size()));
+	}
 
-		png_write_image(png_ptr, const_cast<uint8_t**>(&row_pointers[0]));
+	png_set_IHDR(state.png_ptr, state.info_ptr, width, height,
+		bitsPerChannel, color_type, PNG_INTERLACE_NONE,
+		PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
+	png_set_filter(state.png_ptr, 0, PNG_NO_FILTERS);
+	png_set_sRGB_gAMA_and_cHRM(state.png_ptr, state.info_ptr, PNG_sRGB_INTENT_PERCEPTUAL);
 
+	const auto DefaultCompressionLevel = 1;
+	png_set_compression_level(state.png_ptr, DefaultCompressionLevel);
+	if (compressionBufferSize)
+	{
+		png_set_compression_buffer_size(state.png_ptr, compressionBufferSize);
+	}
 
+	png_write_info(state.png_ptr, state.info_ptr);
+}
+
+PngWriter::~PngWriter()
+{
+}
+
+void PngWriter::WriteRows(const uint8_t* rows, uint32_t count)
+{
+	auto& state = *state_;
+	if (rowsWritten_ + count > height_)
+		throw std::runtime_error("PNG writer: too many rows");
+
+	/* write bytes */
+	if (setjmp(png_jmpbuf(state.png_ptr)))
+		throw std::runtime_error("Error during writing bytes");
+
+	for (auto i = 0u; i < count; ++i)
+	{
+		png_write_row(state.png_ptr, rows + rowBytes_ * i);
+	}
+	rowsWritten_ += count;
+
+	if (rowsWritten_ == height_)
+	{
 		/* end write */
-		if (setjmp(png_jmpbuf(png_ptr)))
+		if (setjmp(png_jmpbuf(state.png_ptr)))
 			throw std::runtime_error("[write_png_file] Error during end of write");
 
-		png_write_end(png_ptr, NULL);
-		png_destroy_write_struct(&png_ptr, &info_ptr);
-		fclose(fp);
-		fp = nullptr;
+		png_write_end(state.png_ptr, NULL);
+		state_.reset();
 	}
-	catch (const std::exception&)
-	{
-		if (fp)
-		{
-			fclose(fp);
-		}
+}
 
-		if (png_ptr || info_ptr)
-		{
-			png_destroy_write_struct(&png_ptr, &info_ptr);
-		}
+void PngWriter::WriteRows(const uint8_t* rows, uint32_t count, uint32_t litBegin, uint32_t litEnd)
+{
+	litEnd = std::min(litEnd, count);
+	litBegin = std::min(litBegin, litEnd);
 
-		throw;
+	blackRow_.resize(rowBytes_, 0);
+	for (auto i = 0u; i < litBegin; ++i)
+	{
+		WriteRows(blackRow_.data(), 1);
+	}
+	if (litEnd > litBegin)
+	{
+		WriteRows(rows + rowBytes_ * litBegin, litEnd - litBegin);
 	}
+	for (auto i = litEnd; i < count; ++i)
+	{
+		WriteRows(blackRow_.data(), 1);
+	}
+}
+
+void WritePng(const std::string& fileName, uint32_t width, uint32_t height, uint32_t bitsPerChannel,
+	const std::vector<uint8_t>& pixData, const std::vector<uint32_t>& palette)
+{
+	WritePng(fileName, width, height, bitsPerChannel, pixData, palette, 0, height);
+}
+
+void WritePng(const std::string& fileName, uint32_t width, uint32_t height, uint32_t bitsPerChannel,
+	const std::vector<uint8_t>& pixData, const std::vector<uint32_t>& palette, uint32_t litRowsBegin, uint32_t litRowsEnd)
+{
+	const auto nChannels = static_cast<uint32_t>(pixData.size() / (width * height));
+
+	// set large buffer to write whole image in single IDAT
+	// to workaround Perfactory PNG reader bug.
+	PngWriter writer(fileName, width, height, bitsPerChannel, nChannels, palette, pixData.size());
+	writer.WriteRows(pixData.data(), height, litRowsBegin, litRowsEnd);
+}
+
+std::vector<uint8_t> EncodePng(uint32_t width, uint32_t height, uint32_t bitsPerChannel,
+	const std::vector<uint8_t>& pixData, const std::vector<uint32_t>& palette)
+{
+	return EncodePng(width, height, bitsPerChannel, pixData, palette, 0, height);
+}
+
+std::vector<uint8_t> EncodePng(uint32_t width, uint32_t height, uint32_t bitsPerChannel,
+	const std::vector<uint8_t>& pixData, const std::vector<uint32_t>& palette, uint32_t litRowsBegin, uint32_t litRowsEnd)
+{
+	const auto nChannels = static_cast<uint32_t>(pixData.size() / (width * height));
+
+	std::vector<uint8_t> output;
+	output.reserve(pixData.size() / 8);
+
+	// same single IDAT workaround as in WritePng
+	PngWriter writer(output, width, height, bitsPerChannel, nChannels, palette, pixData.size());
+	writer.WriteRows(pixData.data(), height, litRowsBegin, litRowsEnd);
+	return output;
+}
+
+void WriteFile(const std::string& fileName, const std::vector<uint8_t>& data)
+{
+	FILE* fp = fopen(fileName.c_str(), "wb");
+	if (!fp)
+		throw std::runtime_error("Can't create file: " + fileName);
+
+	const auto written = fwrite(data.data(), 1, data.size(), fp);
+	fclose(fp);
+
+	if (written != data.size())
+		throw std::runtime_error("Error during writing file: " + fileName);
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <string>
+#include <memory>
 #include <cstdint>
 
 std::vector<uint8_t> ReadPng(const std::string& fileName,
@@ -9,5 +10,48 @@ std::vector<uint8_t> ReadPng(const std::string& fileName,
 void WritePng(const std::string& fileName,
 	uint32_t width, uint32_t height, uint32_t bitsPerChannel,
 	const std::vector<uint8_t>& pixData, const std::vector<uint32_t>& palette = std::vector<uint32_t>());
+// Rows outside of [litRowsBegin, litRowsEnd) are known to be black, they are written without reading pixData.
+void WritePng(const std::string& fileName,
+	uint32_t width, uint32_t height, uint32_t bitsPerChannel,
+	const std::vector<uint8_t>& pixData, const std::vector<uint32_t>& palette, uint32_t litRowsBegin, uint32_t litRowsEnd);
+
+// Encoded PNG is kept in memory, e.g. to write the same image several times.
+std::vector<uint8_t> EncodePng(uint32_t width, uint32_t height, uint32_t bitsPerChannel,
+	const std::vector<uint8_t>& pixData, const std::vector<uint32_t>& palette = std::vector<uint32_t>());
+std::vector<uint8_t> EncodePng(uint32_t width, uint32_t height, uint32_t bitsPerChannel,
+	const std::vector<uint8_t>& pixData, const std::vector<uint32_t>& palette, uint32_t litRowsBegin, uint32_t litRowsEnd);
+void WriteFile(const std::string& fileName, const std::vector<uint8_t>& data);
+
+std::vector<uint32_t> CreateGrayscalePalette();
+
+// Writes PNG row by row, so image does not have to be in memory at once.
+// File is finished when last row is written.
+class PngWriter
+{
+public:
+	// compressionBufferSize: 0 - libpng default
+	PngWriter(const std::string& fileName, uint32_t width, uint32_t height, uint32_t bitsPerChannel, uint32_t channels,
+		const std::vector<uint32_t>& palette = std::vector<uint32_t>(), size_t compressionBufferSize = 0);
+	// PNG is appended to output
+	PngWriter(std::vector<uint8_t>& output, uint32_t width, uint32_t height, uint32_t bitsPerChannel, uint32_t channels,
+		const std::vector<uint32_t>& palette = std::vector<uint32_t>(), size_t compressionBufferSize = 0);
+	~PngWriter();
+
+	void WriteRows(const uint8_t* rows, uint32_t count);
+	// Rows outside of [litBegin, litEnd) are known to be black & are not read, one black row is written instead.
+	void WriteRows(const uint8_t* rows, uint32_t count, uint32_t litBegin, uint32_t litEnd);
+
+private:
+	PngWriter(const PngWriter&) = delete;
+	PngWriter& operator=(const PngWriter&) = delete;
+
+	void Create(uint32_t width, uint32_t height, uint32_t bitsPerChannel, uint32_t channels,
+		const std::vector<uint32_t>& palette, size_t compressionBufferSize, std::vector<uint8_t>* output);
 
-std::vector<uint32_t> CreateGrayscalePalette();
\ No newline at end of file
+	struct State;
+	std::unique_ptr<State> state_;
+	const uint32_t height_;
+	const size_t rowBytes_;
+	uint32_t rowsWritten_;
+	std::vector<uint8_t> blackRow_;
+};
\ No newline at end of file
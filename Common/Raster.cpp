@@ -1,142 +1,782 @@
 #include "Raster.h"
+#include "RasterKernels.h"
 
 #include <ErrorHandling.h>
 
 #include <algorithm>
-#include <iterator>
-#include <unordered_map>
-#include <map>
+#include <cmath>
+#include <limits>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
 
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define RASTER_SSE2
+#include <emmintrin.h>
+#endif
 
-void Dilate(const std::vector<uint8_t>& in, std::vector<uint8_t>& out, int width, int height)
+namespace
 {
-	for (auto y = 1; y < height-1; ++y)
+	const int MinStripRows = 64;
+	// columns processed together by vertical passes
+	const int ColumnChunk = 256;
+
+	template <typename Action>
+	void ForEachStrip(int stripCount, const Action& action)
+	{
+		std::vector<std::future<void>> results;
+		for (auto strip = 1; strip < stripCount; ++strip)
+		{
+			results.push_back(std::async(std::launch::async, [&action, strip]() { action(strip); }));
+		}
+		action(0);
+
+		for (auto& result : results)
+		{
+			result.get();
+		}
+	}
+
+	// Splits [0, size) into ranges of at least minRangeSize items, one per hardware thread.
+	template <typename Action>
+	void ForEachRange(int size, int minRangeSize, const Action& action)
 	{
-		for (auto x = 1; x < width-1; ++x)
+		const auto rangeCount = std::max(1, std::min(static_cast<int>(std::thread::hardware_concurrency()), size / minRangeSize));
+		const auto rangeSize = (size + rangeCount - 1) / rangeCount;
+		ForEachStrip(rangeCount, [&](int range) {
+			action(std::min(size, range * rangeSize), std::min(size, (range + 1) * rangeSize));
+		});
+	}
+
+	// empty rects are ignored
+	RasterRect GetBounds(const RasterRect& a, const RasterRect& b)
+	{
+		if (a.IsEmpty() || b.IsEmpty())
 		{
-			auto m = in[y * width + x];
-			m = std::max(m, in[(y - 1) * width + (x - 1)]);
-			m = std::max(m, in[(y - 1) * width + (x + 0)]);
-			m = std::max(m, in[(y - 1) * width + (x + 1)]);
-			m = std::max(m, in[(y + 0) * width + (x - 1)]);
-			m = std::max(m, in[(y + 0) * width + (x + 1)]);
-			m = std::max(m, in[(y + 1) * width + (x - 1)]);
-			m = std::max(m, in[(y + 1) * width + (x + 0)]);
-			m = std::max(m, in[(y + 1) * width + (x + 1)]);
+			return a.IsEmpty() ? b : a;
+		}
+		return RasterRect{ std::min(a.xBegin, b.xBegin), std::min(a.yBegin, b.yBegin), std::max(a.xEnd, b.xEnd), std::max(a.yEnd, b.yEnd) };
+	}
+
+	// van Herk/Gil-Werman running max over 2 * radius + 1 pixels: padded line is split into blocks of window size,
+	// so every window is a suffix of one block & a prefix of the next one (3 comparisons per pixel for any radius).
+	// Pixels outside of line count as 0.
+	void RunningMax(const uint8_t* in, int count, int radius, uint8_t* out,
+		std::vector<uint8_t>& line, std::vector<uint8_t>& prefixMax, std::vector<uint8_t>& suffixMax)
+	{
+		const auto window = 2 * radius + 1;
+		const auto paddedCount = (count + 2 * radius + window - 1) / window * window;
+		line.assign(paddedCount, 0);
+		prefixMax.resize(paddedCount);
+		suffixMax.resize(paddedCount);
+
+		for (auto i = 0; i < count; ++i)
+		{
+			line[radius + i] = in[i];
+		}
+
+		for (auto i = 0; i < paddedCount; ++i)
+		{
+			prefixMax[i] = i % window == 0 ? line[i] : std::max(prefixMax[i - 1], line[i]);
+		}
+		for (auto i = paddedCount - 1; i >= 0; --i)
+		{
+			suffixMax[i] = (i + 1) % window == 0 ? line[i] : std::max(suffixMax[i + 1], line[i]);
+		}
+
+		// window of pixel i is [i, i + 2 * radius] in padded line
+		for (auto i = 0; i < count; ++i)
+		{
+			out[i] = std::max(suffixMax[i], prefixMax[i + window - 1]);
+		}
+	}
+
+	// Felzenszwalb-Huttenlocher 1D distance transform: squared distances of row are the lower envelope
+	// of parabolas rooted at each pixel with column distances as their heights.
+	void RowDistanceTransform(const float* columnDistances, int width, float* out, std::vector<int>& roots, std::vector<float>& bounds)
+	{
+		roots.resize(width);
+		bounds.resize(width + 1);
+
+		const auto intersection = [&](int a, int b) {
+			return ((columnDistances[b] + static_cast<float>(b) * b) - (columnDistances[a] + static_cast<float>(a) * a)) / (2.0f * (b - a));
+		};
+
+		auto count = 0;
+		roots[0] = 0;
+		bounds[0] = -std::numeric_limits<float>::infinity();
+		bounds[1] = std::numeric_limits<float>::infinity();
+		for (auto x = 1; x < width; ++x)
+		{
+			auto bound = intersection(roots[count], x);
+			while (bound <= bounds[count])
+			{
+				--count;
+				bound = intersection(roots[count], x);
+			}
+			++count;
+			roots[count] = x;
+			bounds[count] = bound;
+			bounds[count + 1] = std::numeric_limits<float>::infinity();
+		}
 
-			out[y * width + x] = m;
+		auto parabola = 0;
+		for (auto x = 0; x < width; ++x)
+		{
+			while (bounds[parabola + 1] < x)
+			{
+				++parabola;
+			}
+			const auto dx = static_cast<float>(x - roots[parabola]);
+			out[x] = dx * dx + columnDistances[roots[parabola]];
 		}
 	}
+
+	// Horizontal 3 pixel pass & max/min of 3 rows of it, rows outside of image are ignored.
+	template <typename Row3, typename Rows>
+	void Filter3x3(const std::vector<uint8_t>& in, std::vector<uint8_t>& out, int width, int height, const Row3& row3, const Rows& rows)
+	{
+		ASSERT(in.size() == static_cast<size_t>(width) * height);
+		out.resize(in.size());
+
+		std::vector<uint8_t> horizontal(in.size());
+		ForEachRange(height, MinStripRows, [&](int begin, int end) {
+			for (auto y = begin; y < end; ++y)
+			{
+				row3(&in[static_cast<size_t>(y) * width], &horizontal[static_cast<size_t>(y) * width], width);
+			}
+		});
+
+		ForEachRange(height, MinStripRows, [&](int begin, int end) {
+			for (auto y = begin; y < end; ++y)
+			{
+				const auto row = &horizontal[static_cast<size_t>(y) * width];
+				const auto outRow = &out[static_cast<size_t>(y) * width];
+				rows(y > 0 ? row - width : row, row, outRow, width);
+				rows(outRow, y + 1 < height ? row + width : row, outRow, width);
+			}
+		});
+	}
+} //namespace
+
+// Rows are scanned in parallel ranges by vector kernels.
+RasterRect FindLitRect(const std::vector<uint8_t>& raster, int width, int height, const RasterRect& searchRect, uint8_t threshold)
+{
+	ASSERT(raster.size() == static_cast<size_t>(width) * height);
+
+	const RasterRect Empty = { 0, 0, 0, 0 };
+	if (searchRect.IsEmpty())
+	{
+		return Empty;
+	}
+
+	const auto rows = searchRect.yEnd - searchRect.yBegin;
+	const auto columns = static_cast<size_t>(searchRect.xEnd - searchRect.xBegin);
+	auto lit = Empty;
+	std::mutex litMutex;
+	ForEachRange(rows, MinStripRows, [&](int begin, int end) {
+		auto rangeLit = Empty;
+		for (auto y = searchRect.yBegin + begin; y < searchRect.yBegin + end; ++y)
+		{
+			const auto row = &raster[static_cast<size_t>(y) * width + searchRect.xBegin];
+			const auto litBegin = FindFirstNotBelow(row, columns, threshold);
+			if (litBegin != columns)
+			{
+				const auto litEnd = FindEndNotBelow(row, columns, threshold);
+				rangeLit = GetBounds(rangeLit, RasterRect{ searchRect.xBegin + static_cast<int>(litBegin), y,
+					searchRect.xBegin + static_cast<int>(litEnd), y + 1 });
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(litMutex);
+		lit = GetBounds(lit, rangeLit);
+	});
+	return lit;
 }
 
-void Segmentize(const std::vector<uint8_t>& in, std::vector<uint32_t>& out, std::vector<Segment>& segments,
-	const int width, const int height, const uint8_t threshold)
+void Dilate(const std::vector<uint8_t>& in, std::vector<uint8_t>& out, int width, int height)
 {
-	ASSERT(in.size() == out.size());
-	// TODO: process edges
-	std::map<uint32_t, uint32_t> segmentNumberMap;
-	segmentNumberMap[0] = 0;
+	Filter3x3(in, out, width, height, MaxRow3, MaxRows);
+}
 
-	uint32_t currentSegmentNumber = 1;
-	for (auto y = 1; y < height; ++y)
+void Erode(const std::vector<uint8_t>& in, std::vector<uint8_t>& out, int width, int height)
+{
+	Filter3x3(in, out, width, height, MinRow3, MinRows);
+}
+
+void ClearNoise(const std::vector<uint8_t>& in, std::vector<uint8_t>& out, int width, int height)
+{
+	std::vector<uint8_t> eroded;
+	Erode(in, eroded, width, height);
+	Dilate(eroded, out, width, height);
+}
+
+void DilateSquare(const std::vector<uint8_t>& in, std::vector<uint8_t>& out, int width, int height, int radius)
+{
+	ASSERT(in.size() == static_cast<size_t>(width) * height);
+	out.resize(in.size());
+	if (radius <= 0)
 	{
-		for (auto x = 1; x < width - 1; ++x)
+		out = in;
+		return;
+	}
+
+	// separable: rows to temporary image, its columns to output
+	std::vector<uint8_t> rowsMax(in.size());
+	ForEachRange(height, MinStripRows, [&](int begin, int end) {
+		std::vector<uint8_t> line, prefixMax, suffixMax;
+		for (auto y = begin; y < end; ++y)
+		{
+			RunningMax(&in[static_cast<size_t>(y) * width], width, radius, &rowsMax[static_cast<size_t>(y) * width], line, prefixMax, suffixMax);
+		}
+	});
+
+	// same running max along columns, but whole rows of column chunk are processed at once by vector kernels
+	const auto window = 2 * radius + 1;
+	const auto paddedHeight = (height + 2 * radius + window - 1) / window * window;
+	ForEachRange(width, ColumnChunk, [&](int begin, int end) {
+		const std::vector<uint8_t> zeros(ColumnChunk, 0);
+		std::vector<uint8_t> prefixMax(static_cast<size_t>(paddedHeight) * ColumnChunk);
+		std::vector<uint8_t> suffixMax(prefixMax.size());
+		for (auto chunkBegin = begin; chunkBegin < end; chunkBegin += ColumnChunk)
 		{
-			if (in[y * width + x] >= threshold)
+			const auto chunkWidth = std::min(ColumnChunk, end - chunkBegin);
+			const auto paddedRow = [&](int y) {
+				return y >= radius && y < height + radius ? &rowsMax[static_cast<size_t>(y - radius) * width + chunkBegin] : zeros.data();
+			};
+			const auto prefixRow = [&](int y) { return &prefixMax[static_cast<size_t>(y) * ColumnChunk]; };
+			const auto suffixRow = [&](int y) { return &suffixMax[static_cast<size_t>(y) * ColumnChunk]; };
+
+			for (auto y = 0; y < paddedHeight; ++y)
 			{
-				const uint32_t samples[] =
+				if (y % window == 0)
 				{
-					out[(y - 1) * width + x - 1],
-					out[(y - 1) * width + x],
-					out[(y - 1) * width + x + 1],
-					out[y * width + x - 1],
-				};
-
-				if (samples[0] == 0 && samples[1] == 0 && samples[2] == 0 && samples[3] == 0)
+					std::copy(paddedRow(y), paddedRow(y) + chunkWidth, prefixRow(y));
+				}
+				else
 				{
-					out[y * width + x] = currentSegmentNumber;
-					segmentNumberMap[currentSegmentNumber] = currentSegmentNumber;
-					++currentSegmentNumber;
+					MaxRows(prefixRow(y - 1), paddedRow(y), prefixRow(y), chunkWidth);
+				}
+			}
+			for (auto y = paddedHeight - 1; y >= 0; --y)
+			{
+				if ((y + 1) % window == 0)
+				{
+					std::copy(paddedRow(y), paddedRow(y) + chunkWidth, suffixRow(y));
 				}
 				else
 				{
-					const auto max = std::max(std::max(samples[0], samples[1]), std::max(samples[2], samples[3]));
-					out[y * width + x] = max;
+					MaxRows(suffixRow(y + 1), paddedRow(y), suffixRow(y), chunkWidth);
+				}
+			}
 
-					for (auto v : samples)
-					{
-						if (v != 0)
-						{
-							auto it = segmentNumberMap.find(v);
-							it->second = std::max(it->second, max);
-						}
-					}
+			for (auto y = 0; y < height; ++y)
+			{
+				MaxRows(suffixRow(y), prefixRow(y + window - 1), &out[static_cast<size_t>(y) * width + chunkBegin], chunkWidth);
+			}
+		}
+	});
+}
+
+// Pixels outside of cropped part count as 0 in both cases, so crop is dilated alone.
+void DilateSquare(const std::vector<uint8_t>& in, std::vector<uint8_t>& out, int width, int height, int radius, const RasterRect& litRect)
+{
+	ASSERT(in.size() == static_cast<size_t>(width) * height);
+
+	radius = std::max(radius, 0);
+	const RasterRect crop =
+	{
+		std::max(0, litRect.xBegin - radius), std::max(0, litRect.yBegin - radius),
+		std::min(width, litRect.xEnd + radius), std::min(height, litRect.yEnd + radius)
+	};
+	if (!litRect.IsEmpty() && crop.GetArea() == in.size())
+	{
+		DilateSquare(in, out, width, height, radius);
+		return;
+	}
+
+	out.assign(in.size(), 0);
+	if (litRect.IsEmpty())
+	{
+		return;
+	}
+
+	const auto cropWidth = crop.xEnd - crop.xBegin;
+	const auto cropHeight = crop.yEnd - crop.yBegin;
+	std::vector<uint8_t> cropped(crop.GetArea());
+	for (auto y = 0; y < cropHeight; ++y)
+	{
+		const auto row = in.begin() + static_cast<size_t>(crop.yBegin + y) * width + crop.xBegin;
+		std::copy(row, row + cropWidth, cropped.begin() + static_cast<size_t>(y) * cropWidth);
+	}
+
+	std::vector<uint8_t> croppedDilated;
+	DilateSquare(cropped, croppedDilated, cropWidth, cropHeight, radius);
+	for (auto y = 0; y < cropHeight; ++y)
+	{
+		const auto row = croppedDilated.begin() + static_cast<size_t>(y) * cropWidth;
+		std::copy(row, row + cropWidth, out.begin() + static_cast<size_t>(crop.yBegin + y) * width + crop.xBegin);
+	}
+}
+
+void DilateCircle(const std::vector<uint8_t>& in, std::vector<uint8_t>& out, int width, int height, float radius, uint8_t threshold)
+{
+	ASSERT(in.size() == static_cast<size_t>(width) * height);
+	out.resize(in.size());
+
+	// squared distance to nearest seed along column, seed-free column gets distance beyond any row;
+	// columns of chunk are swept together row by row, so memory is accessed sequentially
+	const auto NoSeedDistance = static_cast<float>(width + height);
+	std::vector<float> distances(in.size());
+	ForEachRange(width, ColumnChunk, [&](int begin, int end) {
+		std::vector<float> columnDistances(ColumnChunk);
+		for (auto chunkBegin = begin; chunkBegin < end; chunkBegin += ColumnChunk)
+		{
+			const auto chunkWidth = std::min(ColumnChunk, end - chunkBegin);
+			std::fill(columnDistances.begin(), columnDistances.end(), NoSeedDistance);
+			for (auto y = 0; y < height; ++y)
+			{
+				const auto rowOffset = static_cast<size_t>(y) * width + chunkBegin;
+				for (auto x = 0; x < chunkWidth; ++x)
+				{
+					auto& distance = columnDistances[x];
+					distance = in[rowOffset + x] >= threshold ? 0.0f : std::min(distance + 1.0f, NoSeedDistance);
+					distances[rowOffset + x] = distance;
 				}
 			}
-			else
+			for (auto y = height - 1; y >= 0; --y)
+			{
+				const auto rowOffset = static_cast<size_t>(y) * width + chunkBegin;
+				for (auto x = 0; x < chunkWidth; ++x)
+				{
+					auto& distance = columnDistances[x];
+					distance = y == height - 1 ? distances[rowOffset + x] : std::min(distances[rowOffset + x], distance + 1.0f);
+					distances[rowOffset + x] = distance * distance;
+				}
+			}
+		}
+	});
+
+	// antialiased by half pixel like JumpFloodDilateFShader
+	const auto maxDistance = (radius + 0.5f) * (radius + 0.5f);
+	ForEachRange(height, MinStripRows, [&](int begin, int end) {
+		std::vector<float> rowDistances(width);
+		std::vector<int> roots;
+		std::vector<float> bounds;
+		for (auto y = begin; y < end; ++y)
+		{
+			const auto rowOffset = static_cast<size_t>(y) * width;
+			RowDistanceTransform(&distances[rowOffset], width, rowDistances.data(), roots, bounds);
+			for (auto x = 0; x < width; ++x)
 			{
-				out[y * width + x] = 0;
+				auto value = in[rowOffset + x];
+				if (rowDistances[x] < maxDistance)
+				{
+					const auto coverage = std::min(1.0f, radius + 0.5f - std::sqrt(rowDistances[x]));
+					value = std::max(value, static_cast<uint8_t>(coverage * 255.0f + 0.5f));
+				}
+				out[rowOffset + x] = value;
 			}
 		}
+	});
+}
+
+void DilateCircle(const std::vector<uint8_t>& in, std::vector<uint8_t>& out, int width, int height, float radius, const RasterRect& litRect,
+	uint8_t threshold)
+{
+	ASSERT(in.size() == static_cast<size_t>(width) * height);
+
+	// one more pixel for antialiased edge
+	const auto margin = std::max(static_cast<int>(std::ceil(radius)), 0) + 1;
+	const RasterRect crop =
+	{
+		std::max(0, litRect.xBegin - margin), std::max(0, litRect.yBegin - margin),
+		std::min(width, litRect.xEnd + margin), std::min(height, litRect.yEnd + margin)
+	};
+	if (!litRect.IsEmpty() && crop.GetArea() == in.size())
+	{
+		DilateCircle(in, out, width, height, radius, threshold);
+		return;
 	}
 
-	bool allMerged = false;
-	while (!allMerged)
+	out.assign(in.size(), 0);
+	if (litRect.IsEmpty())
 	{
-		allMerged = true;
-		for (auto it = segmentNumberMap.begin(); it != segmentNumberMap.end(); ++it)
+		return;
+	}
+
+	const auto cropWidth = crop.xEnd - crop.xBegin;
+	const auto cropHeight = crop.yEnd - crop.yBegin;
+	std::vector<uint8_t> cropped(crop.GetArea());
+	for (auto y = 0; y < cropHeight; ++y)
+	{
+		const auto row = in.begin() + static_cast<size_t>(crop.yBegin + y) * width + crop.xBegin;
+		std::copy(row, row + cropWidth, cropped.begin() + static_cast<size_t>(y) * cropWidth);
+	}
+
+	std::vector<uint8_t> croppedDilated;
+	DilateCircle(cropped, croppedDilated, cropWidth, cropHeight, radius, threshold);
+	for (auto y = 0; y < cropHeight; ++y)
+	{
+		const auto row = croppedDilated.begin() + static_cast<size_t>(y) * cropWidth;
+		std::copy(row, row + cropWidth, out.begin() + static_cast<size_t>(crop.yBegin + y) * width + crop.xBegin);
+	}
+}
+
+void ExtractChannel(const uint8_t* pixels, size_t rowPitch, uint32_t channel, uint32_t width, uint32_t height, uint8_t* out)
+{
+	const auto BytesPerPixel = 4;
+	ASSERT(channel < BytesPerPixel);
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		const auto row = pixels + rowPitch * y;
+		auto outRow = out + static_cast<size_t>(width) * y;
+		uint32_t x = 0;
+
+#ifdef RASTER_SSE2
+		// 16 pixels per iteration: shift channel down, mask out other ones & pack 32 -> 16 -> 8 bits
+		const auto mask = _mm_set1_epi32(0xFF);
+		const auto shift = _mm_cvtsi32_si128(static_cast<int>(channel * 8));
+		for (; x + 16 <= width; x += 16)
+		{
+			const auto src = reinterpret_cast<const __m128i*>(row + x * BytesPerPixel);
+			const auto p0 = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(src + 0), shift), mask);
+			const auto p1 = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(src + 1), shift), mask);
+			const auto p2 = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(src + 2), shift), mask);
+			const auto p3 = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(src + 3), shift), mask);
+			const auto packed = _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(outRow + x), packed);
+		}
+#endif
+
+		for (; x < width; ++x)
 		{
-			if (segmentNumberMap[it->second] != it->second)
+			outRow[x] = row[x * BytesPerPixel + channel];
+		}
+	}
+}
+
+namespace
+{
+	const float CoverageScale = 1.0f / 255.0f;
+
+	typedef std::atomic<uint32_t> AtomicLabel;
+
+	// Lock-free union-find over provisional labels: roots are linked only under smaller roots,
+	// so root is the first label of its component & parent label is never greater than child one.
+	// Labelling phases are joined by futures, so relaxed accesses are enough within them.
+	uint32_t FindRoot(AtomicLabel* parents, uint32_t label)
+	{
+		for (;;)
+		{
+			const auto parent = parents[label].load(std::memory_order_relaxed);
+			if (parent == label)
 			{
-				it->second = segmentNumberMap[it->second];
-				allMerged = false;
+				return label;
 			}
+
+			// path halving: concurrent halving can only store another ancestor
+			const auto grandParent = parents[parent].load(std::memory_order_relaxed);
+			parents[label].store(grandParent, std::memory_order_relaxed);
+			label = grandParent;
 		}
 	}
 
-	std::unordered_map<uint32_t, Segment> segmentData;
-	for (size_t i = 0; i < out.size(); ++i)
+	uint32_t Unite(AtomicLabel* parents, uint32_t a, uint32_t b)
 	{
-		const auto current = out[i] = segmentNumberMap[out[i]];
-		const auto currentX = static_cast<int>(i % width);
-		const auto currentY = static_cast<int>(i / width);
-		if (current > 0)
+		for (;;)
 		{
-			auto it = segmentData.find(current);
-			if (it == segmentData.end())
+			a = FindRoot(parents, a);
+			b = FindRoot(parents, b);
+			if (a == b)
+			{
+				return a;
+			}
+			if (a > b)
 			{
-				it = segmentData.emplace(current, Segment{ current, 0, currentX, currentY, currentX+1, currentY+1}).first;
+				std::swap(a, b);
+			}
+
+			// b may have been linked by another strip boundary meanwhile
+			auto expected = b;
+			if (parents[b].compare_exchange_weak(expected, a, std::memory_order_relaxed))
+			{
+				return a;
 			}
-			++it->second.count;
-			it->second.xBegin = std::min(it->second.xBegin, currentX);
-			it->second.yBegin = std::min(it->second.yBegin, currentY);
-			it->second.xEnd = std::max(it->second.xEnd, currentX+1);
-			it->second.yEnd = std::max(it->second.yEnd, currentY+1);
 		}
 	}
 
-	segments.reserve(segmentData.size());
-	std::transform(segmentData.begin(), segmentData.end(), std::back_inserter(segments), [](const auto& v) {
-		return v.second;
-	});
+	void MergeSegment(Segment& to, const Segment& from)
+	{
+		to.count += from.count;
+		to.coverage += from.coverage;
+		to.xBegin = std::min(to.xBegin, from.xBegin);
+		to.yBegin = std::min(to.yBegin, from.yBegin);
+		to.xEnd = std::max(to.xEnd, from.xEnd);
+		to.yEnd = std::max(to.yEnd, from.yEnd);
+	}
+
+	// Partially covered pixel belongs to the first component among its 8 neighbours (0 when there is none).
+	template <typename ComponentOf>
+	uint32_t FindFringeOwner(int x, int y, int width, int height, const ComponentOf& componentOf)
+	{
+		uint32_t owner = 0;
+		for (auto neighbourY = std::max(0, y - 1); neighbourY < std::min(height, y + 2); ++neighbourY)
+		{
+			for (auto neighbourX = std::max(0, x - 1); neighbourX < std::min(width, x + 2); ++neighbourX)
+			{
+				const auto component = componentOf(static_cast<size_t>(neighbourY) * width + neighbourX);
+				if (component != 0 && (owner == 0 || component < owner))
+				{
+					owner = component;
+				}
+			}
+		}
+		return owner;
+	}
+
+	// First pass over rows [yBegin, yEnd) & columns [xBegin, xEnd) with 8-connectivity: provisional labels are given
+	// by already visited neighbours of the strip (previous row & left pixel). Strip labels start after labelBase,
+	// segments collects pixel count & bounds of each of them.
+	void LabelStrip(const std::vector<uint8_t>& in, std::vector<uint32_t>& out, AtomicLabel* parents, std::vector<Segment>& segments,
+		int width, int xBegin, int xEnd, int yBegin, int yEnd, uint8_t threshold, uint32_t labelBase)
+	{
+		for (auto y = yBegin; y < yEnd; ++y)
+		{
+			const auto row = &in[static_cast<size_t>(y) * width];
+			const auto outRow = &out[static_cast<size_t>(y) * width];
+			const auto previousOutRow = y > yBegin ? outRow - width : nullptr;
+			for (auto x = xBegin; x < xEnd; ++x)
+			{
+				if (row[x] < threshold)
+				{
+					outRow[x] = 0;
+					continue;
+				}
+
+				// pixel above touches all other visited neighbours, so they are already united with it
+				uint32_t label = previousOutRow ? previousOutRow[x] : 0;
+				if (label == 0)
+				{
+					const uint32_t neighbours[] =
+					{
+						x > xBegin ? outRow[x - 1] : 0,
+						previousOutRow && x > xBegin ? previousOutRow[x - 1] : 0,
+						previousOutRow && x + 1 < xEnd ? previousOutRow[x + 1] : 0,
+					};
+					for (const auto neighbour : neighbours)
+					{
+						if (neighbour != 0)
+						{
+							label = label == 0 ? neighbour : Unite(parents, label, neighbour);
+						}
+					}
+				}
+
+				if (label == 0)
+				{
+					label = labelBase + static_cast<uint32_t>(segments.size()) + 1;
+					parents[label].store(label, std::memory_order_relaxed);
+					segments.push_back(Segment{ label, 0, x, y, x + 1, y + 1, 0.0f });
+				}
+				outRow[x] = label;
+
+				MergeSegment(segments[label - labelBase - 1], Segment{ label, 1, x, y, x + 1, y + 1, row[x] * CoverageScale });
+			}
+		}
+	}
+} //namespace
+
+// Rows are labelled in parallel strips, labels touching across strip boundaries are united concurrently.
+// Then provisional labels are numbered in their order (parents precede children), fringe coverage
+// is summed per strip & pixels are relabelled in parallel.
+void Segmentize(const std::vector<uint8_t>& in, std::vector<uint32_t>& out, std::vector<Segment>& segments,
+	const int width, const int height, const uint8_t threshold)
+{
+	Segmentize(in, out, segments, width, height, GetFullRect(width, height), threshold);
 }
 
-float CalculateSegmentArea(const Segment& segment, float physPixelArea, const std::vector<uint8_t>& raster, const std::vector<uint32_t>& segmentedRaster, int width, int height)
+// Only litRect is labelled: the rest of output is cleared first, so neighbour lookups around it see background.
+void Segmentize(const std::vector<uint8_t>& in, std::vector<uint32_t>& out, std::vector<Segment>& segments,
+	const int width, const int height, const RasterRect& litRect, const uint8_t threshold)
 {
-	const auto xRange = ExpandRange(segment.xBegin, segment.xEnd, 0, width);
-	const auto yRange = ExpandRange(segment.yBegin, segment.yEnd, 0, height);
+	ASSERT(in.size() == out.size());
+	ASSERT(in.size() == static_cast<size_t>(width) * height);
+
+	segments.clear();
+	if (litRect.IsEmpty())
+	{
+		std::fill(out.begin(), out.end(), 0);
+		return;
+	}
 
-	float area = 0.0f;
-	ForEachPixel(xRange, yRange, [&](auto x, auto y)
+	const auto xBegin = litRect.xBegin;
+	const auto xEnd = litRect.xEnd;
+	std::fill(out.begin(), out.begin() + static_cast<size_t>(litRect.yBegin) * width, 0);
+	std::fill(out.begin() + static_cast<size_t>(litRect.yEnd) * width, out.end(), 0);
+	for (auto y = litRect.yBegin; y < litRect.yEnd; ++y)
 	{
-		const auto currentPixel = raster[y*width + x];
+		const auto outRow = out.begin() + static_cast<size_t>(y) * width;
+		std::fill(outRow, outRow + xBegin, 0);
+		std::fill(outRow + xEnd, outRow + width, 0);
+	}
+
+	const auto rows = litRect.yEnd - litRect.yBegin;
+	const auto stripCount = std::max(1, std::min(static_cast<int>(std::thread::hardware_concurrency()), rows / MinStripRows));
+	const auto stripRows = (rows + stripCount - 1) / stripCount;
+	// label space of each strip is its pixel count, so strip of label is known without lookup
+	const auto stripLabels = static_cast<uint32_t>(stripRows) * (xEnd - xBegin);
+	const auto stripBegin = [&](int strip) { return litRect.yBegin + std::min(rows, strip * stripRows); };
+
+	// only labels in use are initialized, label 0 is background
+	std::unique_ptr<AtomicLabel[]> parents(new AtomicLabel[static_cast<size_t>(stripCount) * stripLabels + 1]);
+	std::vector<std::vector<Segment>> stripSegments(stripCount);
+	ForEachStrip(stripCount, [&](int strip) {
+		LabelStrip(in, out, parents.get(), stripSegments[strip], width, xBegin, xEnd, stripBegin(strip), stripBegin(strip + 1),
+			threshold, strip * stripLabels);
+	});
+
+	ForEachStrip(stripCount - 1, [&](int boundary) {
+		const auto y = stripBegin(boundary + 1);
+		if (y >= litRect.yEnd)
+		{
+			return;
+		}
 
-		if (currentPixel > 0 && AnyOfPixels(ExpandRange(x, x + 1, 0, width), ExpandRange(y, y + 1, 0, height),
-			[&](auto x, auto y) { return segmentedRaster[y*width + x] == segment.val; }))
+		const auto outRow = &out[static_cast<size_t>(y) * width];
+		const auto previousOutRow = outRow - width;
+		for (auto x = xBegin; x < xEnd; ++x)
 		{
-			area += physPixelArea * currentPixel / 255.0f;
+			if (outRow[x] == 0)
+			{
+				continue;
+			}
+			for (auto neighbourX = std::max(xBegin, x - 1); neighbourX < std::min(xEnd, x + 2); ++neighbourX)
+			{
+				if (previousOutRow[neighbourX] != 0)
+				{
+					Unite(parents.get(), outRow[x], previousOutRow[neighbourX]);
+				}
+			}
 		}
 	});
 
-	return area;
+	std::vector<std::vector<uint32_t>> stripComponents(stripCount);
+	for (auto strip = 0; strip < stripCount; ++strip)
+	{
+		auto& components = stripComponents[strip];
+		components.resize(stripSegments[strip].size());
+		for (size_t i = 0; i < components.size(); ++i)
+		{
+			const auto label = strip * stripLabels + static_cast<uint32_t>(i) + 1;
+			const auto root = FindRoot(parents.get(), label);
+			if (root == label)
+			{
+				segments.push_back(stripSegments[strip][i]);
+				components[i] = segments.back().val = static_cast<uint32_t>(segments.size());
+			}
+			else
+			{
+				const auto rootStrip = (root - 1) / stripLabels;
+				components[i] = stripComponents[rootStrip][root - rootStrip * stripLabels - 1];
+				MergeSegment(segments[components[i] - 1], stripSegments[strip][i]);
+			}
+		}
+	}
+
+	// provisional labels are still in place, so neighbours in other strips are read safely
+	const auto componentOf = [&](size_t pixelIndex) -> uint32_t {
+		const auto label = out[pixelIndex];
+		if (label == 0)
+		{
+			return 0;
+		}
+		const auto strip = (label - 1) / stripLabels;
+		return stripComponents[strip][label - strip * stripLabels - 1];
+	};
+
+	std::vector<std::vector<float>> stripFringes(stripCount);
+	ForEachStrip(stripCount, [&](int strip) {
+		auto& fringe = stripFringes[strip];
+		fringe.assign(segments.size(), 0.0f);
+		for (auto y = stripBegin(strip); y < stripBegin(strip + 1); ++y)
+		{
+			const auto row = &in[static_cast<size_t>(y) * width];
+			for (auto x = xBegin; x < xEnd; ++x)
+			{
+				if (row[x] == 0 || row[x] >= threshold)
+				{
+					continue;
+				}
+
+				const auto owner = FindFringeOwner(x, y, width, height, componentOf);
+				if (owner != 0)
+				{
+					fringe[owner - 1] += row[x] * CoverageScale;
+				}
+			}
+		}
+	});
+
+	for (const auto& fringe : stripFringes)
+	{
+		for (size_t i = 0; i < segments.size(); ++i)
+		{
+			segments[i].coverage += fringe[i];
+		}
+	}
+
+	ForEachStrip(stripCount, [&](int strip) {
+		const auto labelBase = strip * stripLabels;
+		const auto& components = stripComponents[strip];
+		for (auto y = stripBegin(strip); y < stripBegin(strip + 1); ++y)
+		{
+			const auto outRow = &out[static_cast<size_t>(y) * width];
+			for (auto x = xBegin; x < xEnd; ++x)
+			{
+				if (outRow[x] != 0)
+				{
+					outRow[x] = components[outRow[x] - labelBase - 1];
+				}
+			}
+		}
+	});
+}
+
+// Fringe pixel takes the first component around it, same as in Segmentize.
+void FillSegments(std::vector<uint8_t>& raster, const std::vector<uint32_t>& segmentedRaster, const std::vector<uint8_t>& fills,
+	int width, int height)
+{
+	FillSegments(raster, segmentedRaster, fills, width, height, GetFullRect(width, height));
+}
+
+void FillSegments(std::vector<uint8_t>& raster, const std::vector<uint32_t>& segmentedRaster, const std::vector<uint8_t>& fills,
+	int width, int height, const RasterRect& litRect)
+{
+	ASSERT(raster.size() == segmentedRaster.size());
+	ASSERT(raster.size() == static_cast<size_t>(width) * height);
+
+	for (auto y = litRect.yBegin; y < litRect.yEnd; ++y)
+	{
+		for (auto x = litRect.xBegin; x < litRect.xEnd; ++x)
+		{
+			const auto pixelIndex = static_cast<size_t>(y) * width + x;
+			if (raster[pixelIndex] == 0)
+			{
+				continue;
+			}
+
+			auto component = segmentedRaster[pixelIndex];
+			if (component == 0)
+			{
+				component = FindFringeOwner(x, y, width, height, [&](size_t index) { return segmentedRaster[index]; });
+			}
+			if (component != 0)
+			{
+				raster[pixelIndex] = fills[component - 1];
+			}
+		}
+	}
 }
\ No newline at end of file
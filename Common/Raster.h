@@ -1,10 +1,55 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
 #include <vector>
-#include <utility>
 
+// Pixels [xBegin, xEnd) x [yBegin, yEnd).
+struct RasterRect
+{
+	int xBegin, yBegin;
+	int xEnd, yEnd;
+
+	bool IsEmpty() const { return xBegin >= xEnd || yBegin >= yEnd; }
+	size_t GetArea() const { return IsEmpty() ? 0 : static_cast<size_t>(xEnd - xBegin) * (yEnd - yBegin); }
+};
+
+inline RasterRect GetFullRect(int width, int height)
+{
+	return RasterRect{ 0, 0, width, height };
+}
+
+// Bounds of pixels not below threshold (empty rect when there are none).
+// Only searchRect is scanned, pixels outside of it should be known to be black.
+RasterRect FindLitRect(const std::vector<uint8_t>& raster, int width, int height, const RasterRect& searchRect, uint8_t threshold = 1);
+
+// 3x3 max/min (pixels outside of raster are ignored).
 void Dilate(const std::vector<uint8_t>& in, std::vector<uint8_t>& out, int width, int height);
+void Erode(const std::vector<uint8_t>& in, std::vector<uint8_t>& out, int width, int height);
+// 3x3 opening (erosion followed by dilation): isolated junk pixels & specks thinner than 3 pixels are cleared.
+void ClearNoise(const std::vector<uint8_t>& in, std::vector<uint8_t>& out, int width, int height);
+
+// Max over (2 * radius + 1)^2 square around each pixel (pixels outside of raster count as 0).
+// Cost per pixel doesn't depend on radius, rows & columns are processed in parallel.
+void DilateSquare(const std::vector<uint8_t>& in, std::vector<uint8_t>& out, int width, int height, int radius);
+// Same, pixels outside of litRect are black: only its part expanded by radius is processed, the rest of out is cleared.
+void DilateSquare(const std::vector<uint8_t>& in, std::vector<uint8_t>& out, int width, int height, int radius, const RasterRect& litRect);
+
+// Pixels within radius of any pixel not below threshold are set (antialiased by half pixel), others are kept.
+// Based on exact euclidean distance transform, so cost per pixel doesn't depend on radius either.
+void DilateCircle(const std::vector<uint8_t>& in, std::vector<uint8_t>& out, int width, int height, float radius, uint8_t threshold = 1);
+// Same, pixels outside of litRect are black: only its part expanded by radius is processed, the rest of out is cleared.
+void DilateCircle(const std::vector<uint8_t>& in, std::vector<uint8_t>& out, int width, int height, float radius, const RasterRect& litRect,
+	uint8_t threshold = 1);
+
+// Copies given byte of each 4-byte pixel (readback of RGBA/BGRA render target).
+// rowPitch: source row size in bytes.
+void ExtractChannel(const uint8_t* pixels, size_t rowPitch, uint32_t channel, uint32_t width, uint32_t height, uint8_t* out);
+
+inline void ExtractFirstChannel(const uint8_t* pixels, size_t rowPitch, uint32_t width, uint32_t height, uint8_t* out)
+{
+	ExtractChannel(pixels, rowPitch, 0, width, height, out);
+}
 
 struct Segment
 {
@@ -12,43 +57,23 @@ struct Segment
 	uint32_t count;
 	int xBegin, yBegin;
 	int xEnd, yEnd;
+	// coverage of component pixels & of fringe pixels below threshold it owns, in full pixels
+	float coverage;
 };
 
+// Labels 8-connected components of pixels not below threshold.
+// out: component number of each pixel (0 for background), segments[i] describes component i + 1.
+// Fringe pixel (covered, but below threshold) is owned by the first component among its neighbours.
 void Segmentize(const std::vector<uint8_t>& in, std::vector<uint32_t>& out, std::vector<Segment>& segments,
 	const int width, const int height, const uint8_t threshold = 1);
+// Same, pixels outside of litRect are black: they are labelled as background in bulk.
+void Segmentize(const std::vector<uint8_t>& in, std::vector<uint32_t>& out, std::vector<Segment>& segments,
+	const int width, const int height, const RasterRect& litRect, const uint8_t threshold = 1);
 
-float CalculateSegmentArea(const Segment& segment, float physPixelArea,
-	const std::vector<uint8_t>& raster, const std::vector<uint32_t>& segmentedRaster, int width, int height);
-
-inline std::pair<int, int> ExpandRange(int begin, int end, int min, int max)
-{
-	return std::make_pair(begin > min ? begin - 1 : begin, end < max ? end + 1 : end);
-}
-
-template <typename Action>
-void ForEachPixel(const std::pair<int, int>& xRange, const std::pair<int, int>& yRange, const Action& action)
-{
-	for (auto y = yRange.first; y < yRange.second; ++y)
-	{
-		for (auto x = xRange.first; x < xRange.second; ++x)
-		{
-			action(x, y);
-		}
-	}
-}
-
-template <typename Predicate>
-bool AnyOfPixels(const std::pair<int, int>& xRange, const std::pair<int, int>& yRange, const Predicate& pred)
-{
-	for (auto y = yRange.first; y < yRange.second; ++y)
-	{
-		for (auto x = xRange.first; x < xRange.second; ++x)
-		{
-			if (pred(x, y))
-			{
-				return true;
-			}
-		}
-	}
-	return false;
-}
\ No newline at end of file
+// Sets pixels of each component & its fringe (partially covered pixels around it) to fills[component - 1],
+// other pixels are kept.
+void FillSegments(std::vector<uint8_t>& raster, const std::vector<uint32_t>& segmentedRaster, const std::vector<uint8_t>& fills,
+	int width, int height);
+// Same, only pixels in litRect are visited (others should be black).
+void FillSegments(std::vector<uint8_t>& raster, const std::vector<uint32_t>& segmentedRaster, const std::vector<uint8_t>& fills,
+	int width, int height, const RasterRect& litRect);
\ No newline at end of file
@@ -0,0 +1,502 @@
+#include "RasterKernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define RASTER_KERNELS_SSE2
+#include <emmintrin.h>
+
+// AVX2 code is compiled regardless of target architecture & called only when CPU supports it
+#define RASTER_KERNELS_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace
+{
+	struct Max
+	{
+		uint8_t operator()(uint8_t a, uint8_t b) const { return std::max(a, b); }
+	};
+
+	struct Min
+	{
+		uint8_t operator()(uint8_t a, uint8_t b) const { return std::min(a, b); }
+	};
+
+	// out[i] for i in [begin, end), row borders included
+	template <typename Op>
+	void Row3(const uint8_t* in, uint8_t* out, size_t count, size_t begin, size_t end, const Op& op)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			auto value = in[i];
+			if (i > 0)
+			{
+				value = op(value, in[i - 1]);
+			}
+			if (i + 1 < count)
+			{
+				value = op(value, in[i + 1]);
+			}
+			out[i] = value;
+		}
+	}
+
+#ifdef RASTER_KERNELS_SSE2
+	// lowest/highest set bit of non-zero movemask
+#ifdef _MSC_VER
+	int FirstBit(uint32_t mask)
+	{
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return static_cast<int>(index);
+	}
+
+	int LastBit(uint32_t mask)
+	{
+		unsigned long index;
+		_BitScanReverse(&index, mask);
+		return static_cast<int>(index);
+	}
+#else
+	int FirstBit(uint32_t mask) { return __builtin_ctz(mask); }
+	int LastBit(uint32_t mask) { return 31 - __builtin_clz(mask); }
+#endif
+#endif
+
+	namespace Scalar
+	{
+		void MaxRows(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				out[i] = std::max(a[i], b[i]);
+			}
+		}
+
+		void MinRows(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				out[i] = std::min(a[i], b[i]);
+			}
+		}
+
+		void SubtractRows(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				out[i] = a[i] > b[i] ? a[i] - b[i] : 0;
+			}
+		}
+
+		void ThresholdRow(const uint8_t* in, uint8_t* out, size_t count, uint8_t threshold)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				out[i] = in[i] >= threshold ? 255 : 0;
+			}
+		}
+
+		size_t FindFirstNotBelow(const uint8_t* in, size_t count, uint8_t threshold)
+		{
+			return std::find_if(in, in + count, [threshold](uint8_t value) { return value >= threshold; }) - in;
+		}
+
+		size_t FindEndNotBelow(const uint8_t* in, size_t count, uint8_t threshold)
+		{
+			for (auto i = count; i > 0; --i)
+			{
+				if (in[i - 1] >= threshold)
+				{
+					return i;
+				}
+			}
+			return 0;
+		}
+
+		void MaxRow3(const uint8_t* in, uint8_t* out, size_t count)
+		{
+			Row3(in, out, count, 0, count, Max());
+		}
+
+		void MinRow3(const uint8_t* in, uint8_t* out, size_t count)
+		{
+			Row3(in, out, count, 0, count, Min());
+		}
+	} //namespace Scalar
+
+#ifdef RASTER_KERNELS_SSE2
+	namespace Sse2
+	{
+		const size_t Width = sizeof(__m128i);
+
+		__m128i Load(const uint8_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+		void Store(uint8_t* p, __m128i v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+
+		void MaxRows(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count)
+		{
+			size_t i = 0;
+			for (; i + Width <= count; i += Width)
+			{
+				Store(out + i, _mm_max_epu8(Load(a + i), Load(b + i)));
+			}
+			Scalar::MaxRows(a + i, b + i, out + i, count - i);
+		}
+
+		void MinRows(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count)
+		{
+			size_t i = 0;
+			for (; i + Width <= count; i += Width)
+			{
+				Store(out + i, _mm_min_epu8(Load(a + i), Load(b + i)));
+			}
+			Scalar::MinRows(a + i, b + i, out + i, count - i);
+		}
+
+		void SubtractRows(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count)
+		{
+			size_t i = 0;
+			for (; i + Width <= count; i += Width)
+			{
+				Store(out + i, _mm_subs_epu8(Load(a + i), Load(b + i)));
+			}
+			Scalar::SubtractRows(a + i, b + i, out + i, count - i);
+		}
+
+		void ThresholdRow(const uint8_t* in, uint8_t* out, size_t count, uint8_t threshold)
+		{
+			// unsigned in >= threshold is max(in, threshold) == in
+			const auto thresholds = _mm_set1_epi8(static_cast<char>(threshold));
+			size_t i = 0;
+			for (; i + Width <= count; i += Width)
+			{
+				const auto values = Load(in + i);
+				Store(out + i, _mm_cmpeq_epi8(_mm_max_epu8(values, thresholds), values));
+			}
+			Scalar::ThresholdRow(in + i, out + i, count - i, threshold);
+		}
+
+		uint32_t NotBelowMask(const uint8_t* in, __m128i thresholds)
+		{
+			const auto values = Load(in);
+			return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(values, thresholds), values)));
+		}
+
+		size_t FindFirstNotBelow(const uint8_t* in, size_t count, uint8_t threshold)
+		{
+			const auto thresholds = _mm_set1_epi8(static_cast<char>(threshold));
+			size_t i = 0;
+			for (; i + Width <= count; i += Width)
+			{
+				if (const auto mask = NotBelowMask(in + i, thresholds))
+				{
+					return i + FirstBit(mask);
+				}
+			}
+			return i + Scalar::FindFirstNotBelow(in + i, count - i, threshold);
+		}
+
+		size_t FindEndNotBelow(const uint8_t* in, size_t count, uint8_t threshold)
+		{
+			const auto thresholds = _mm_set1_epi8(static_cast<char>(threshold));
+			auto i = count;
+			for (; i >= Width; i -= Width)
+			{
+				if (const auto mask = NotBelowMask(in + i - Width, thresholds))
+				{
+					return i - Width + LastBit(mask) + 1;
+				}
+			}
+			return Scalar::FindEndNotBelow(in, i, threshold);
+		}
+
+		void MaxRow3(const uint8_t* in, uint8_t* out, size_t count)
+		{
+			size_t i = 1;
+			for (; i + Width + 1 <= count; i += Width)
+			{
+				Store(out + i, _mm_max_epu8(_mm_max_epu8(Load(in + i - 1), Load(in + i)), Load(in + i + 1)));
+			}
+			Row3(in, out, count, 0, std::min<size_t>(1, count), Max());
+			Row3(in, out, count, i, count, Max());
+		}
+
+		void MinRow3(const uint8_t* in, uint8_t* out, size_t count)
+		{
+			size_t i = 1;
+			for (; i + Width + 1 <= count; i += Width)
+			{
+				Store(out + i, _mm_min_epu8(_mm_min_epu8(Load(in + i - 1), Load(in + i)), Load(in + i + 1)));
+			}
+			Row3(in, out, count, 0, std::min<size_t>(1, count), Min());
+			Row3(in, out, count, i, count, Min());
+		}
+	} //namespace Sse2
+#endif
+
+#ifdef RASTER_KERNELS_AVX2
+	namespace Avx2
+	{
+		const size_t Width = sizeof(__m256i);
+
+		AVX2_TARGET __m256i Load(const uint8_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+		AVX2_TARGET void Store(uint8_t* p, __m256i v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+
+		AVX2_TARGET void MaxRows(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count)
+		{
+			size_t i = 0;
+			for (; i + Width <= count; i += Width)
+			{
+				Store(out + i, _mm256_max_epu8(Load(a + i), Load(b + i)));
+			}
+			Sse2::MaxRows(a + i, b + i, out + i, count - i);
+		}
+
+		AVX2_TARGET void MinRows(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count)
+		{
+			size_t i = 0;
+			for (; i + Width <= count; i += Width)
+			{
+				Store(out + i, _mm256_min_epu8(Load(a + i), Load(b + i)));
+			}
+			Sse2::MinRows(a + i, b + i, out + i, count - i);
+		}
+
+		AVX2_TARGET void SubtractRows(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count)
+		{
+			size_t i = 0;
+			for (; i + Width <= count; i += Width)
+			{
+				Store(out + i, _mm256_subs_epu8(Load(a + i), Load(b + i)));
+			}
+			Sse2::SubtractRows(a + i, b + i, out + i, count - i);
+		}
+
+		AVX2_TARGET void ThresholdRow(const uint8_t* in, uint8_t* out, size_t count, uint8_t threshold)
+		{
+			const auto thresholds = _mm256_set1_epi8(static_cast<char>(threshold));
+			size_t i = 0;
+			for (; i + Width <= count; i += Width)
+			{
+				const auto values = Load(in + i);
+				Store(out + i, _mm256_cmpeq_epi8(_mm256_max_epu8(values, thresholds), values));
+			}
+			Sse2::ThresholdRow(in + i, out + i, count - i, threshold);
+		}
+
+		AVX2_TARGET uint32_t NotBelowMask(const uint8_t* in, __m256i thresholds)
+		{
+			const auto values = Load(in);
+			return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(values, thresholds), values)));
+		}
+
+		AVX2_TARGET size_t FindFirstNotBelow(const uint8_t* in, size_t count, uint8_t threshold)
+		{
+			const auto thresholds = _mm256_set1_epi8(static_cast<char>(threshold));
+			size_t i = 0;
+			for (; i + Width <= count; i += Width)
+			{
+				if (const auto mask = NotBelowMask(in + i, thresholds))
+				{
+					return i + FirstBit(mask);
+				}
+			}
+			return i + Sse2::FindFirstNotBelow(in + i, count - i, threshold);
+		}
+
+		AVX2_TARGET size_t FindEndNotBelow(const uint8_t* in, size_t count, uint8_t threshold)
+		{
+			const auto thresholds = _mm256_set1_epi8(static_cast<char>(threshold));
+			auto i = count;
+			for (; i >= Width; i -= Width)
+			{
+				if (const auto mask = NotBelowMask(in + i - Width, thresholds))
+				{
+					return i - Width + LastBit(mask) + 1;
+				}
+			}
+			return Sse2::FindEndNotBelow(in, i, threshold);
+		}
+
+		AVX2_TARGET void MaxRow3(const uint8_t* in, uint8_t* out, size_t count)
+		{
+			size_t i = 1;
+			for (; i + Width + 1 <= count; i += Width)
+			{
+				Store(out + i, _mm256_max_epu8(_mm256_max_epu8(Load(in + i - 1), Load(in + i)), Load(in + i + 1)));
+			}
+			Row3(in, out, count, 0, std::min<size_t>(1, count), Max());
+			Row3(in, out, count, i, count, Max());
+		}
+
+		AVX2_TARGET void MinRow3(const uint8_t* in, uint8_t* out, size_t count)
+		{
+			size_t i = 1;
+			for (; i + Width + 1 <= count; i += Width)
+			{
+				Store(out + i, _mm256_min_epu8(_mm256_min_epu8(Load(in + i - 1), Load(in + i)), Load(in + i + 1)));
+			}
+			Row3(in, out, count, 0, std::min<size_t>(1, count), Min());
+			Row3(in, out, count, i, count, Min());
+		}
+	} //namespace Avx2
+
+	// CPU has AVX2 & OS saves its registers
+	bool IsAvx2Supported()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+		{
+			return false;
+		}
+
+		__cpuid(info, 1);
+		const auto OsxSaveBit = 1 << 27;
+		const auto AvxBit = 1 << 28;
+		if ((info[2] & OsxSaveBit) == 0 || (info[2] & AvxBit) == 0 || (_xgetbv(0) & 6) != 6)
+		{
+			return false;
+		}
+
+		__cpuidex(info, 7, 0);
+		const auto Avx2Bit = 1 << 5;
+		return (info[1] & Avx2Bit) != 0;
+#else
+		return __builtin_cpu_supports("avx2") != 0;
+#endif
+	}
+#endif
+
+	struct Kernels
+	{
+		const char* instructionSet;
+		void (*maxRows)(const uint8_t*, const uint8_t*, uint8_t*, size_t);
+		void (*minRows)(const uint8_t*, const uint8_t*, uint8_t*, size_t);
+		void (*subtractRows)(const uint8_t*, const uint8_t*, uint8_t*, size_t);
+		void (*thresholdRow)(const uint8_t*, uint8_t*, size_t, uint8_t);
+		size_t (*findFirstNotBelow)(const uint8_t*, size_t, uint8_t);
+		size_t (*findEndNotBelow)(const uint8_t*, size_t, uint8_t);
+		void (*maxRow3)(const uint8_t*, uint8_t*, size_t);
+		void (*minRow3)(const uint8_t*, uint8_t*, size_t);
+	};
+
+	const Kernels ScalarKernels = { "scalar", Scalar::MaxRows, Scalar::MinRows, Scalar::SubtractRows, Scalar::ThresholdRow,
+		Scalar::FindFirstNotBelow, Scalar::FindEndNotBelow, Scalar::MaxRow3, Scalar::MinRow3 };
+#ifdef RASTER_KERNELS_SSE2
+	const Kernels Sse2Kernels = { "SSE2", Sse2::MaxRows, Sse2::MinRows, Sse2::SubtractRows, Sse2::ThresholdRow,
+		Sse2::FindFirstNotBelow, Sse2::FindEndNotBelow, Sse2::MaxRow3, Sse2::MinRow3 };
+#endif
+#ifdef RASTER_KERNELS_AVX2
+	const Kernels Avx2Kernels = { "AVX2", Avx2::MaxRows, Avx2::MinRows, Avx2::SubtractRows, Avx2::ThresholdRow,
+		Avx2::FindFirstNotBelow, Avx2::FindEndNotBelow, Avx2::MaxRow3, Avx2::MinRow3 };
+#endif
+
+	const Kernels* SelectKernels()
+	{
+#ifdef RASTER_KERNELS_AVX2
+		if (IsAvx2Supported())
+		{
+			return &Avx2Kernels;
+		}
+#endif
+#ifdef RASTER_KERNELS_SSE2
+		return &Sse2Kernels;
+#else
+		return &ScalarKernels;
+#endif
+	}
+
+	const Kernels*& CurrentKernels()
+	{
+		static const Kernels* kernels = SelectKernels();
+		return kernels;
+	}
+
+	const Kernels& GetKernels()
+	{
+		return *CurrentKernels();
+	}
+} //namespace
+
+void MaxRows(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count)
+{
+	GetKernels().maxRows(a, b, out, count);
+}
+
+void MinRows(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count)
+{
+	GetKernels().minRows(a, b, out, count);
+}
+
+void SubtractRows(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count)
+{
+	GetKernels().subtractRows(a, b, out, count);
+}
+
+void ThresholdRow(const uint8_t* in, uint8_t* out, size_t count, uint8_t threshold)
+{
+	GetKernels().thresholdRow(in, out, count, threshold);
+}
+
+size_t FindFirstNotBelow(const uint8_t* in, size_t count, uint8_t threshold)
+{
+	return GetKernels().findFirstNotBelow(in, count, threshold);
+}
+
+size_t FindEndNotBelow(const uint8_t* in, size_t count, uint8_t threshold)
+{
+	return GetKernels().findEndNotBelow(in, count, threshold);
+}
+
+void MaxRow3(const uint8_t* in, uint8_t* out, size_t count)
+{
+	GetKernels().maxRow3(in, out, count);
+}
+
+void MinRow3(const uint8_t* in, uint8_t* out, size_t count)
+{
+	GetKernels().minRow3(in, out, count);
+}
+
+const char* GetRasterKernelsInstructionSet()
+{
+	return GetKernels().instructionSet;
+}
+
+bool SelectRasterKernels(const char* instructionSet)
+{
+	const Kernels* kernels = nullptr;
+	if (std::strcmp(instructionSet, ScalarKernels.instructionSet) == 0)
+	{
+		kernels = &ScalarKernels;
+	}
+#ifdef RASTER_KERNELS_SSE2
+	if (std::strcmp(instructionSet, Sse2Kernels.instructionSet) == 0)
+	{
+		kernels = &Sse2Kernels;
+	}
+#endif
+#ifdef RASTER_KERNELS_AVX2
+	if (std::strcmp(instructionSet, Avx2Kernels.instructionSet) == 0 && IsAvx2Supported())
+	{
+		kernels = &Avx2Kernels;
+	}
+#endif
+
+	if (!kernels)
+	{
+		return false;
+	}
+	CurrentKernels() = kernels;
+	return true;
+}
\ No newline at end of file
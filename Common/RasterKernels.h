@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Row kernels over 8-bit pixels, CPU counterparts of 2D filter shaders.
+// SSE2/AVX2 versions are picked once at runtime, other CPUs run scalar ones.
+// Output may be the same row as any input except for 3-pixel kernels.
+
+// out = max(a, b) (CombineMaxFShader)
+void MaxRows(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count);
+// out = min(a, b)
+void MinRows(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count);
+// out = max(a - b, 0)
+void SubtractRows(const uint8_t* a, const uint8_t* b, uint8_t* out, size_t count);
+// out = in >= threshold ? 255 : 0
+void ThresholdRow(const uint8_t* in, uint8_t* out, size_t count, uint8_t threshold);
+
+// Index of the first pixel not below threshold, count when there is none.
+size_t FindFirstNotBelow(const uint8_t* in, size_t count, uint8_t threshold);
+// Index after the last pixel not below threshold, 0 when there is none.
+size_t FindEndNotBelow(const uint8_t* in, size_t count, uint8_t threshold);
+
+// Max/min of pixel & its left & right neighbours (pixels outside of row are ignored),
+// horizontal pass of 3x3 kernel (MaxFilterFShader with kernelSize 3).
+void MaxRow3(const uint8_t* in, uint8_t* out, size_t count);
+void MinRow3(const uint8_t* in, uint8_t* out, size_t count);
+
+// "AVX2", "SSE2" or "scalar"
+const char* GetRasterKernelsInstructionSet();
+// Switches kernels to given instruction set, false when it's not compiled or CPU doesn't support it.
+// Meant for tests comparing vector kernels with scalar ones, so it's not synchronized with kernel calls.
+bool SelectRasterKernels(const char* instructionSet);
\ No newline at end of file
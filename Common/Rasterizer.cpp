@@ -0,0 +1,228 @@
+#include "Rasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	uint8_t GetPixelValue(float accumulated, bool antialiased)
+	{
+		const float coverage = std::min(1.0f, std::abs(accumulated));
+		return antialiased ?
+			static_cast<uint8_t>(coverage * 255.0f + 0.5f) :
+			(coverage >= 0.5f ? 255 : 0);
+	}
+} //namespace
+
+CoverageRasterizer::CoverageRasterizer(int width, int height) :
+	width_(width),
+	height_(height),
+	// two extra cells: edge crossing last column spills area to the right of it
+	stride_(width + 2),
+	accumulation_(static_cast<size_t>(stride_) * height, 0.0f),
+	touchedBegins_(height),
+	touchedEnds_(height)
+{
+	for (int y = 0; y < height_; ++y)
+	{
+		ResetTouched(y);
+	}
+}
+
+void CoverageRasterizer::ResetTouched(int y)
+{
+	touchedBegins_[y] = std::numeric_limits<int>::max();
+	touchedEnds_[y] = 0;
+}
+
+void CoverageRasterizer::AddEdge(const glm::vec2& from, const glm::vec2& to)
+{
+	if (from.y == to.y)
+	{
+		return;
+	}
+
+	// Edge parts outside of raster are projected onto its left/right border:
+	// winding for pixels inside is kept and nothing is written outside of row.
+	float splits[2];
+	size_t splitCount = 0;
+	for (const auto border : { 0.0f, static_cast<float>(width_) })
+	{
+		if ((from.x < border) != (to.x < border))
+		{
+			splits[splitCount++] = (border - from.x) / (to.x - from.x);
+		}
+	}
+	if (splitCount == 2 && splits[1] < splits[0])
+	{
+		std::swap(splits[0], splits[1]);
+	}
+
+	const auto clampX = [this](glm::vec2 p) {
+		p.x = std::min(std::max(p.x, 0.0f), static_cast<float>(width_));
+		return p;
+	};
+
+	auto start = from;
+	for (size_t i = 0; i < splitCount; ++i)
+	{
+		const auto end = from + (to - from) * splits[i];
+		AccumulateLine(clampX(start), clampX(end));
+		start = end;
+	}
+	AccumulateLine(clampX(start), clampX(to));
+}
+
+void CoverageRasterizer::AccumulateLine(const glm::vec2& from, const glm::vec2& to)
+{
+	if (from.y == to.y)
+	{
+		return;
+	}
+
+	const bool goesUp = from.y < to.y;
+	const auto& p0 = goesUp ? from : to;
+	const auto& p1 = goesUp ? to : from;
+	const float dir = goesUp ? 1.0f : -1.0f;
+
+	const float dxdy = (p1.x - p0.x) / (p1.y - p0.y);
+	const int yBegin = std::max(0, static_cast<int>(std::floor(p0.y)));
+	const int yEnd = std::min(height_, static_cast<int>(std::ceil(p1.y)));
+
+	float x = p0.x + (std::max(static_cast<float>(yBegin), p0.y) - p0.y) * dxdy;
+	for (int y = yBegin; y < yEnd; ++y)
+	{
+		float* row = &accumulation_[static_cast<size_t>(y) * stride_];
+
+		const float dy = std::min(y + 1.0f, p1.y) - std::max(static_cast<float>(y), p0.y);
+		const float xNext = x + dxdy * dy;
+		const float d = dy * dir;
+
+		// interpolation error may step just outside of clamped range, cells before row start belong to previous row
+		const float xLeft = std::max(std::min(x, xNext), 0.0f);
+		const float xRight = std::min(std::max(x, xNext), static_cast<float>(width_));
+		const float xLeftFloor = std::floor(xLeft);
+		const float xRightCeil = std::ceil(xRight);
+		const int xLeftIndex = static_cast<int>(xLeftFloor);
+		const int xRightIndex = static_cast<int>(xRightCeil);
+		touchedBegins_[y] = std::min(touchedBegins_[y], xLeftIndex);
+		touchedEnds_[y] = std::max(touchedEnds_[y], std::max(xRightIndex, xLeftIndex + 1) + 1);
+
+		if (xRightIndex <= xLeftIndex + 1)
+		{
+			// line crosses single cell: split area by its middle x
+			const float xMiddle = 0.5f * (x + xNext) - xLeftFloor;
+			row[xLeftIndex] += d - d * xMiddle;
+			row[xLeftIndex + 1] += d * xMiddle;
+		}
+		else
+		{
+			const float s = 1.0f / (xRight - xLeft);
+			const float xLeftFraction = xLeft - xLeftFloor;
+			const float areaFirst = 0.5f * s * (1.0f - xLeftFraction) * (1.0f - xLeftFraction);
+			const float xRightFraction = xRight - xRightCeil + 1.0f;
+			const float areaLast = 0.5f * s * xRightFraction * xRightFraction;
+
+			row[xLeftIndex] += d * areaFirst;
+			if (xRightIndex == xLeftIndex + 2)
+			{
+				row[xLeftIndex + 1] += d * (1.0f - areaFirst - areaLast);
+			}
+			else
+			{
+				const float areaSecond = s * (1.5f - xLeftFraction);
+				row[xLeftIndex + 1] += d * (areaSecond - areaFirst);
+				for (int xi = xLeftIndex + 2; xi < xRightIndex - 1; ++xi)
+				{
+					row[xi] += d * s;
+				}
+				const float areaBeforeLast = areaSecond + (xRightIndex - xLeftIndex - 3) * s;
+				row[xRightIndex - 1] += d * (1.0f - areaBeforeLast - areaLast);
+			}
+			row[xRightIndex] += d * areaLast;
+		}
+
+		x = xNext;
+	}
+}
+
+void CoverageRasterizer::Resolve(std::vector<uint8_t>& out, bool antialiased)
+{
+	out.assign(static_cast<size_t>(width_) * height_, 0);
+
+	for (int y = 0; y < height_; ++y)
+	{
+		float* row = &accumulation_[static_cast<size_t>(y) * stride_];
+		uint8_t* outRow = &out[static_cast<size_t>(y) * width_];
+
+		float accumulated = 0.0f;
+		for (int x = touchedBegins_[y]; x < touchedEnds_[y]; ++x)
+		{
+			accumulated += row[x];
+			row[x] = 0.0f;
+
+			if (x < width_)
+			{
+				outRow[x] = GetPixelValue(accumulated, antialiased);
+			}
+		}
+
+		// nonzero only for broken (not closed) contours
+		if (touchedEnds_[y] < width_)
+		{
+			std::fill(outRow + touchedEnds_[y], outRow + width_, GetPixelValue(accumulated, antialiased));
+		}
+		ResetTouched(y);
+	}
+}
+
+void CoverageRasterizer::Resolve(RunRaster& out, bool antialiased)
+{
+	out = RunRaster(width_, height_);
+
+	for (int y = 0; y < height_; ++y)
+	{
+		float* row = &accumulation_[static_cast<size_t>(y) * stride_];
+
+		float accumulated = 0.0f;
+		int runBegin = 0;
+		uint8_t runValue = 0;
+		for (int x = touchedBegins_[y]; x < touchedEnds_[y]; ++x)
+		{
+			accumulated += row[x];
+			row[x] = 0.0f;
+
+			const auto value = x < width_ ? GetPixelValue(accumulated, antialiased) : 0;
+			if (value != runValue)
+			{
+				if (runValue != 0)
+				{
+					out.AddRun(y, runBegin, x - runBegin, runValue);
+				}
+				runBegin = x;
+				runValue = value;
+			}
+		}
+
+		// the rest of row has the last value (nonzero only for broken contours)
+		if (touchedEnds_[y] < width_)
+		{
+			const auto value = GetPixelValue(accumulated, antialiased);
+			if (value != runValue)
+			{
+				if (runValue != 0)
+				{
+					out.AddRun(y, runBegin, touchedEnds_[y] - runBegin, runValue);
+				}
+				runBegin = touchedEnds_[y];
+				runValue = value;
+			}
+		}
+		if (runValue != 0)
+		{
+			out.AddRun(y, runBegin, width_ - runBegin, runValue);
+		}
+		ResetTouched(y);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "RunRaster.h"
+
+#include <vector>
+#include <cstdint>
+
+// Exact area coverage rasterizer.
+// Edges accumulate signed area per cell, Resolve integrates it along scanlines (nonzero fill rule).
+// Row 0 is bottom row, same as GL readback.
+class CoverageRasterizer
+{
+public:
+	CoverageRasterizer(int width, int height);
+
+	int GetWidth() const { return width_; }
+	int GetHeight() const { return height_; }
+
+	// Edges are in pixel coordinates, contours should be closed (orientation does not matter).
+	void AddEdge(const glm::vec2& from, const glm::vec2& to);
+
+	// Writes 8-bit coverage (or 0/255 by half coverage when not antialiased) & clears accumulated edges.
+	void Resolve(std::vector<uint8_t>& out, bool antialiased);
+	// Same, but runs are emitted directly, so only parts of rows crossed by edges are visited.
+	void Resolve(RunRaster& out, bool antialiased);
+
+private:
+	void AccumulateLine(const glm::vec2& from, const glm::vec2& to);
+	void ResetTouched(int y);
+
+	const int width_;
+	const int height_;
+	const int stride_;
+	std::vector<float> accumulation_;
+	// cells [begin, end) of each row got area from edges, accumulated coverage is constant outside of them
+	std::vector<int> touchedBegins_;
+	std::vector<int> touchedEnds_;
+};
\ No newline at end of file
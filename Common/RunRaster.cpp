@@ -0,0 +1,395 @@
+#include "RunRaster.h"
+
+#include <ErrorHandling.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+	// Run continuing the last one with the same value extends it.
+	void AppendRun(std::vector<Run>& runs, int begin, int length, uint8_t value)
+	{
+		if (!runs.empty() && runs.back().End() == begin && runs.back().value == value)
+		{
+			runs.back().length += length;
+			return;
+		}
+		runs.push_back(Run{ begin, length, value });
+	}
+
+	// Sweeps over run boundaries of both rows, operation(0, 0) should be 0.
+	// emit(begin, length, value) gets non-zero results from left to right.
+	template <typename Operation, typename Emit>
+	void CombineRows(const Run* a, const Run* aEnd, const Run* b, const Run* bEnd, const Operation& operation, const Emit& emit)
+	{
+		const auto NoRun = std::numeric_limits<int>::max();
+		auto x = std::min(a != aEnd ? a->begin : NoRun, b != bEnd ? b->begin : NoRun);
+		while (a != aEnd || b != bEnd)
+		{
+			// value of each row at x & where it changes
+			const auto sample = [x, NoRun](const Run* run, const Run* end, uint8_t& value, int& next) {
+				value = 0;
+				next = NoRun;
+				if (run != end)
+				{
+					value = x < run->begin ? 0 : run->value;
+					next = x < run->begin ? run->begin : run->End();
+				}
+			};
+
+			uint8_t aValue, bValue;
+			int aNext, bNext;
+			sample(a, aEnd, aValue, aNext);
+			sample(b, bEnd, bValue, bNext);
+
+			const auto next = std::min(aNext, bNext);
+			const auto value = operation(aValue, bValue);
+			if (value != 0)
+			{
+				emit(x, next - x, value);
+			}
+
+			x = next;
+			if (a != aEnd && x >= a->End())
+			{
+				++a;
+			}
+			if (b != bEnd && x >= b->End())
+			{
+				++b;
+			}
+		}
+	}
+
+	template <typename Operation>
+	RunRaster Combine(const RunRaster& a, const RunRaster& b, const Operation& operation)
+	{
+		ASSERT(a.GetWidth() == b.GetWidth() && a.GetHeight() == b.GetHeight());
+
+		RunRaster out(a.GetWidth(), a.GetHeight());
+		for (auto y = 0; y < a.GetHeight(); ++y)
+		{
+			CombineRows(a.GetRowBegin(y), a.GetRowEnd(y), b.GetRowBegin(y), b.GetRowEnd(y), operation,
+				[&out, y](int begin, int length, uint8_t value) { out.AddRun(y, begin, length, value); });
+		}
+		return out;
+	}
+
+	void UniteRows(const std::vector<Run>& a, const std::vector<Run>& b, std::vector<Run>& out)
+	{
+		out.clear();
+		CombineRows(a.data(), a.data() + a.size(), b.data(), b.data() + b.size(),
+			[](uint8_t aValue, uint8_t bValue) { return std::max(aValue, bValue); },
+			[&out](int begin, int length, uint8_t value) { AppendRun(out, begin, length, value); });
+	}
+
+	uint32_t FindRoot(std::vector<uint32_t>& parents, uint32_t index)
+	{
+		while (parents[index] != index)
+		{
+			parents[index] = parents[parents[index]];
+			index = parents[index];
+		}
+		return index;
+	}
+
+	// root is the first run of component, so numbering roots in run order keeps scan order
+	void Unite(std::vector<uint32_t>& parents, uint32_t a, uint32_t b)
+	{
+		a = FindRoot(parents, a);
+		b = FindRoot(parents, b);
+		if (a != b)
+		{
+			parents[std::max(a, b)] = std::min(a, b);
+		}
+	}
+} //namespace
+
+RunRaster::RunRaster() :
+	width_(0),
+	height_(0),
+	lastRow_(-1)
+{
+}
+
+RunRaster::RunRaster(int width, int height) :
+	width_(width),
+	height_(height),
+	lastRow_(-1),
+	rowBegins_(height, 0)
+{
+}
+
+RunRaster::RunRaster(const std::vector<uint8_t>& raster, int width, int height) :
+	RunRaster(raster, width, height, GetFullRect(width, height))
+{
+}
+
+RunRaster::RunRaster(const std::vector<uint8_t>& raster, int width, int height, const RasterRect& litRect) :
+	RunRaster(width, height)
+{
+	ASSERT(raster.size() == static_cast<size_t>(width) * height);
+
+	for (auto y = litRect.yBegin; y < litRect.yEnd; ++y)
+	{
+		const auto row = &raster[static_cast<size_t>(y) * width];
+		for (auto x = litRect.xBegin; x < litRect.xEnd;)
+		{
+			const auto value = row[x];
+			const auto begin = x;
+			while (x < litRect.xEnd && row[x] == value)
+			{
+				++x;
+			}
+
+			if (value != 0)
+			{
+				AddRun(y, begin, x - begin, value);
+			}
+		}
+	}
+}
+
+RunRaster::RunRaster(const BitRaster& bits) :
+	RunRaster(bits.GetWidth(), bits.GetHeight())
+{
+	for (auto y = 0; y < height_; ++y)
+	{
+		bits.ForEachRun(y, [this, y](int xBegin, int xEnd) { AddRun(y, xBegin, xEnd - xBegin, 255); });
+	}
+}
+
+void RunRaster::ToBytes(std::vector<uint8_t>& out) const
+{
+	out.assign(static_cast<size_t>(width_) * height_, 0);
+	for (auto y = 0; y < height_; ++y)
+	{
+		const auto outRow = &out[static_cast<size_t>(y) * width_];
+		for (auto run = GetRowBegin(y); run != GetRowEnd(y); ++run)
+		{
+			std::fill(outRow + run->begin, outRow + run->End(), run->value);
+		}
+	}
+}
+
+BitRaster RunRaster::ToBits() const
+{
+	BitRaster out(width_, height_);
+	for (auto y = 0; y < height_; ++y)
+	{
+		const auto outRow = out.GetRow(y);
+		for (auto run = GetRowBegin(y); run != GetRowEnd(y); ++run)
+		{
+			for (auto x = run->begin; x < run->End(); ++x)
+			{
+				outRow[x / BitRaster::WordBits] |= 1ull << (x % BitRaster::WordBits);
+			}
+		}
+	}
+	return out;
+}
+
+void RunRaster::AddRun(int y, int begin, int length, uint8_t value)
+{
+	ASSERT(y >= lastRow_ && y < height_ && begin >= 0 && length > 0 && begin + length <= width_);
+
+	for (; lastRow_ < y; ++lastRow_)
+	{
+		rowBegins_[lastRow_ + 1] = runs_.size();
+	}
+
+	ASSERT(GetRowBegin(y) == GetRowEnd(y) || runs_.back().End() <= begin);
+	if (GetRowBegin(y) != GetRowEnd(y))
+	{
+		AppendRun(runs_, begin, length, value);
+	}
+	else
+	{
+		runs_.push_back(Run{ begin, length, value });
+	}
+}
+
+size_t RunRaster::Count() const
+{
+	size_t count = 0;
+	for (const auto& run : runs_)
+	{
+		count += run.length;
+	}
+	return count;
+}
+
+float RunRaster::GetCoverage() const
+{
+	uint64_t sum = 0;
+	for (const auto& run : runs_)
+	{
+		sum += static_cast<uint64_t>(run.length) * run.value;
+	}
+	return sum / 255.0f;
+}
+
+RunRaster Union(const RunRaster& a, const RunRaster& b)
+{
+	return Combine(a, b, [](uint8_t aValue, uint8_t bValue) { return std::max(aValue, bValue); });
+}
+
+RunRaster Difference(const RunRaster& a, const RunRaster& b)
+{
+	return Combine(a, b, [](uint8_t aValue, uint8_t bValue) { return static_cast<uint8_t>(aValue > bValue ? aValue - bValue : 0); });
+}
+
+// Rows are expanded by radius, then columns are combined the same way as in bit raster dilation:
+// span of s rows is doubled by uniting it with the one s rows below until s <= window < 2s,
+// so window [y - radius, y + radius] is union of spans starting at y - radius & y + radius + 1 - s.
+RunRaster DilateSquare(const RunRaster& in, int radius)
+{
+	const auto width = in.GetWidth();
+	const auto height = in.GetHeight();
+	radius = std::max(radius, 0);
+
+	std::vector<std::vector<Run>> rows(height);
+	for (auto y = 0; y < height; ++y)
+	{
+		auto& row = rows[y];
+		for (auto run = in.GetRowBegin(y); run != in.GetRowEnd(y); ++run)
+		{
+			const auto begin = std::max(run->begin - radius, 0);
+			const auto end = std::min(run->End() + radius, width);
+			if (!row.empty() && row.back().End() >= begin)
+			{
+				row.back().length = end - row.back().begin;
+			}
+			else
+			{
+				row.push_back(Run{ begin, end - begin, 255 });
+			}
+		}
+	}
+
+	// windows crossing the first row get prefix unions before spans overwrite rows
+	RunRaster out(width, height);
+	std::vector<Run> prefix;
+	std::vector<Run> united;
+	const auto addRow = [&out](int y, const std::vector<Run>& row) {
+		for (const auto& run : row)
+		{
+			out.AddRun(y, run.begin, run.length, run.value);
+		}
+	};
+	for (auto y = 0; y < std::min(radius, height); ++y)
+	{
+		for (auto i = y == 0 ? 0 : y + radius; i <= y + radius && i < height; ++i)
+		{
+			UniteRows(prefix, rows[i], united);
+			std::swap(prefix, united);
+		}
+		addRow(y, prefix);
+	}
+
+	const auto window = 2 * radius + 1;
+	auto spanSize = 1;
+	for (; spanSize * 2 <= window; spanSize *= 2)
+	{
+		// row y + s is not updated yet
+		for (auto y = 0; y + spanSize < height; ++y)
+		{
+			UniteRows(rows[y], rows[y + spanSize], united);
+			std::swap(rows[y], united);
+		}
+	}
+
+	for (auto y = radius; y < height; ++y)
+	{
+		const auto second = y + radius + 1 - spanSize;
+		if (second < height)
+		{
+			UniteRows(rows[y - radius], rows[second], united);
+			addRow(y, united);
+		}
+		else
+		{
+			addRow(y, rows[y - radius]);
+		}
+	}
+	return out;
+}
+
+void SegmentizeRuns(const RunRaster& in, std::vector<uint32_t>& runLabels, std::vector<Segment>& segments, const uint8_t threshold)
+{
+	const auto runCount = in.GetRunCount();
+
+	// background runs are left as their own roots & not numbered
+	std::vector<uint32_t> parents(runCount);
+	for (size_t i = 0; i < runCount; ++i)
+	{
+		parents[i] = static_cast<uint32_t>(i);
+	}
+
+	for (auto y = 0; y < in.GetHeight(); ++y)
+	{
+		auto above = y > 0 ? in.GetRowBegin(y - 1) : nullptr;
+		const auto aboveEnd = y > 0 ? in.GetRowEnd(y - 1) : nullptr;
+		const Run* previous = nullptr;
+		for (auto run = in.GetRowBegin(y); run != in.GetRowEnd(y); ++run)
+		{
+			if (run->value < threshold)
+			{
+				previous = nullptr;
+				continue;
+			}
+
+			const auto index = static_cast<uint32_t>(in.GetRunIndex(run));
+			if (previous && previous->End() == run->begin)
+			{
+				Unite(parents, static_cast<uint32_t>(in.GetRunIndex(previous)), index);
+			}
+			previous = run;
+
+			// runs above touching [begin - 1, end + 1), the last one may touch the next run as well
+			for (; above != aboveEnd && above->End() < run->begin; ++above)
+			{
+			}
+			for (auto touching = above; touching != aboveEnd && touching->begin <= run->End(); ++touching)
+			{
+				if (touching->value >= threshold)
+				{
+					Unite(parents, static_cast<uint32_t>(in.GetRunIndex(touching)), index);
+				}
+			}
+		}
+	}
+
+	runLabels.assign(runCount, 0);
+	segments.clear();
+	for (auto y = 0; y < in.GetHeight(); ++y)
+	{
+		for (auto run = in.GetRowBegin(y); run != in.GetRowEnd(y); ++run)
+		{
+			if (run->value < threshold)
+			{
+				continue;
+			}
+
+			const auto index = static_cast<uint32_t>(in.GetRunIndex(run));
+			const auto root = FindRoot(parents, index);
+			if (root == index)
+			{
+				runLabels[index] = static_cast<uint32_t>(segments.size()) + 1;
+				segments.push_back(Segment{ runLabels[index], 0, run->begin, y, run->End(), y + 1, 0.0f });
+			}
+			else
+			{
+				runLabels[index] = runLabels[root];
+			}
+
+			auto& segment = segments[runLabels[index] - 1];
+			segment.count += run->length;
+			segment.coverage += run->length * run->value / 255.0f;
+			segment.xBegin = std::min(segment.xBegin, run->begin);
+			segment.xEnd = std::max(segment.xEnd, run->End());
+			segment.yEnd = y + 1;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "BitRaster.h"
+#include "Raster.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Pixels [begin, begin + length) of a row have the same value.
+struct Run
+{
+	int begin;
+	int length;
+	uint8_t value;
+
+	int End() const { return begin + length; }
+};
+
+// Scanline raster kept as sorted runs of equal non-zero pixels, background (0) is not stored.
+// Operations cost is proportional to number of runs, so mostly black slices are cheap.
+class RunRaster
+{
+public:
+	RunRaster();
+	RunRaster(int width, int height);
+	RunRaster(const std::vector<uint8_t>& raster, int width, int height);
+	// pixels outside of litRect should be black, they are not read
+	RunRaster(const std::vector<uint8_t>& raster, int width, int height, const RasterRect& litRect);
+	// set pixels become 255
+	explicit RunRaster(const BitRaster& bits);
+
+	void ToBytes(std::vector<uint8_t>& out) const;
+	BitRaster ToBits() const;
+
+	// Rows should be added in non-decreasing order & runs in a row from left to right without overlapping.
+	// Run continuing previous one with the same value extends it.
+	void AddRun(int y, int begin, int length, uint8_t value);
+
+	int GetWidth() const { return width_; }
+	int GetHeight() const { return height_; }
+	size_t GetRunCount() const { return runs_.size(); }
+	const Run* GetRowBegin(int y) const { return runs_.data() + (y <= lastRow_ ? rowBegins_[y] : runs_.size()); }
+	const Run* GetRowEnd(int y) const { return runs_.data() + (y < lastRow_ ? rowBegins_[y + 1] : runs_.size()); }
+	// index of run in the whole raster (runs are in scan order)
+	size_t GetRunIndex(const Run* run) const { return run - runs_.data(); }
+
+	bool Empty() const { return runs_.empty(); }
+	// number of non-zero pixels
+	size_t Count() const;
+	// sum of pixel values in full pixels
+	float GetCoverage() const;
+
+private:
+	int width_;
+	int height_;
+	// rowBegins_[y] is valid up to the last row with runs, the following rows are empty
+	int lastRow_;
+	std::vector<size_t> rowBegins_;
+	std::vector<Run> runs_;
+};
+
+// Per pixel max.
+RunRaster Union(const RunRaster& a, const RunRaster& b);
+// Per pixel saturated a - b (same as GPU layer difference).
+RunRaster Difference(const RunRaster& a, const RunRaster& b);
+
+// Pixels within (2 * radius + 1)^2 square around any non-zero pixel are set to 255, others are cleared.
+RunRaster DilateSquare(const RunRaster& in, int radius);
+
+// Labels 8-connected components of pixels not below threshold, runs below it are background.
+// runLabels: component number of each run (0 for background), segments[i] describes component i + 1,
+// components are numbered in order of their first run.
+void SegmentizeRuns(const RunRaster& in, std::vector<uint32_t>& runLabels, std::vector<Segment>& segments,
+	const uint8_t threshold = 1);
\ No newline at end of file
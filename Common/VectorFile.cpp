@@ -0,0 +1,178 @@
+#include "VectorFile.h"
+#include "Contours.h"
+
+#include <stdexcept>
+#include <limits>
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+	// fixed width, so header can be patched in place
+	std::string FormatHeaderNumber(float value)
+	{
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), "%+011.4f", value);
+		return buffer;
+	}
+
+	std::string FormatLayersCount(uint32_t layers)
+	{
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), "%06u", layers);
+		return buffer;
+	}
+} //namespace
+
+void WriteSvg(const std::string& fileName, uint32_t width, uint32_t height, float physicalWidth, float physicalHeight,
+	const std::vector<Contour>& contours)
+{
+	std::ofstream f(fileName, std::ios::out | std::ios::trunc);
+	if (!f)
+		throw std::runtime_error("Can't create svg file");
+
+	// enough for subpixel precision at large resolutions
+	f.precision(8);
+	f << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+	f << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << physicalWidth << "mm\" height=\"" << physicalHeight << "mm\" "
+		<< "viewBox=\"0 0 " << width << " " << height << "\">\n";
+	f << "<rect width=\"" << width << "\" height=\"" << height << "\" fill=\"black\"/>\n";
+	f << "<path fill=\"white\" fill-rule=\"nonzero\" d=\"";
+	for (const auto& contour : contours)
+	{
+		for (size_t i = 0; i < contour.points.size(); ++i)
+		{
+			f << (i == 0 ? "M" : "L") << contour.points[i].x << " " << contour.points[i].y;
+		}
+		if (contour.closed)
+		{
+			f << "Z";
+		}
+	}
+	f << "\"/>\n";
+	f << "</svg>\n";
+
+	if (!f)
+		throw std::runtime_error("Error during writing svg file");
+}
+
+CliWriter::CliWriter(const std::string& fileName, const glm::vec2& pixelSize) :
+	file_(fileName, std::ios::out | std::ios::binary | std::ios::trunc),
+	pixelSize_(pixelSize),
+	dimensionPos_(0),
+	layersPos_(0),
+	layers_(0),
+	min_(std::numeric_limits<float>::max()),
+	max_(std::numeric_limits<float>::lowest())
+{
+	if (!file_)
+		throw std::runtime_error("Can't create cli file");
+
+	file_ << "$$HEADERSTART\n";
+	file_ << "$$BINARY\n";
+	file_ << "$$UNITS/00000001.000000\n";
+	file_ << "$$VERSION/200\n";
+	file_ << "$$LABEL/1,part1\n";
+	file_ << "$$DIMENSION/";
+	dimensionPos_ = file_.tellp();
+	for (auto i = 0; i < 6; ++i)
+	{
+		file_ << (i ? "," : "") << FormatHeaderNumber(0.0f);
+	}
+	file_ << "\n";
+	file_ << "$$LAYERS/";
+	layersPos_ = file_.tellp();
+	file_ << FormatLayersCount(0) << "\n";
+	file_ << "$$HEADEREND";
+}
+
+CliWriter::~CliWriter()
+{
+	try
+	{
+		Close();
+	}
+	catch (...)
+	{
+	}
+}
+
+template <typename T>
+void CliWriter::Write(T value)
+{
+	file_.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void CliWriter::AddLayer(float z, const std::vector<Contour>& contours)
+{
+	const uint16_t StartLayerLong = 127;
+	const uint16_t PolylineLong = 130;
+	const int32_t Clockwise = 0;
+	const int32_t CounterClockwise = 1;
+	const int32_t Open = 2;
+	const int32_t PartId = 1;
+
+	Write(StartLayerLong);
+	Write(z);
+
+	for (const auto& contour : contours)
+	{
+		if (contour.points.size() < 2)
+		{
+			continue;
+		}
+
+		int32_t direction = Open;
+		if (contour.closed)
+		{
+			// outer contours have material on the left, so they are counter-clockwise
+			const auto area = CalculateSignedArea(contour.points);
+			direction = area > 0.0f ? CounterClockwise : Clockwise;
+		}
+
+		// closed polyline repeats its first point
+		const auto pointsCount = contour.points.size() + (contour.closed ? 1 : 0);
+		Write(PolylineLong);
+		Write(PartId);
+		Write(direction);
+		Write(static_cast<int32_t>(pointsCount));
+		for (size_t i = 0; i < pointsCount; ++i)
+		{
+			const auto point = contour.points[i % contour.points.size()] * pixelSize_;
+			Write(point.x);
+			Write(point.y);
+
+			min_ = glm::min(min_, glm::vec3(point, 0.0f));
+			max_ = glm::max(max_, glm::vec3(point, z));
+		}
+	}
+
+	++layers_;
+	if (!file_)
+		throw std::runtime_error("Error during writing cli file");
+}
+
+void CliWriter::Close()
+{
+	if (!file_.is_open())
+	{
+		return;
+	}
+
+	if (layers_ > 0 && min_.x <= max_.x)
+	{
+		file_.seekp(dimensionPos_);
+		const float dimension[] = { min_.x, min_.y, min_.z, max_.x, max_.y, max_.z };
+		for (auto i = 0; i < 6; ++i)
+		{
+			file_ << (i ? "," : "") << FormatHeaderNumber(dimension[i]);
+		}
+	}
+
+	file_.seekp(layersPos_);
+	file_ << FormatLayersCount(layers_);
+
+	file_.close();
+	if (!file_)
+		throw std::runtime_error("Error during closing cli file");
+}
\ No newline at end of file
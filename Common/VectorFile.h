@@ -0,0 +1,45 @@
+#pragma once
+
+#include "MeshSlicer.h"
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Contours are in image pixel coordinates, filled by nonzero rule.
+void WriteSvg(const std::string& fileName, uint32_t width, uint32_t height, float physicalWidth, float physicalHeight,
+	const std::vector<Contour>& contours);
+
+// Common Layer Interface binary file, written layer by layer.
+// Closed contours should have material on the left, their direction is derived from it.
+// Layer count & dimensions in header are updated when file is closed.
+class CliWriter
+{
+public:
+	// pixelSize: size of contour coordinates unit in mm
+	CliWriter(const std::string& fileName, const glm::vec2& pixelSize);
+	~CliWriter();
+
+	// z: layer top height (mm)
+	void AddLayer(float z, const std::vector<Contour>& contours);
+	void Close();
+
+private:
+	CliWriter(const CliWriter&) = delete;
+	CliWriter& operator=(const CliWriter&) = delete;
+
+	template <typename T>
+	void Write(T value);
+
+	std::ofstream file_;
+	const glm::vec2 pixelSize_;
+	std::streamoff dimensionPos_;
+	std::streamoff layersPos_;
+	uint32_t layers_;
+	glm::vec3 min_;
+	glm::vec3 max_;
+};
\ No newline at end of file
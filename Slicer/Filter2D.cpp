@@ -0,0 +1,120 @@
+#include "Filter2D.h"
+#include "Shaders.h"
+
+#include <glm/ext.hpp>
+
+Filter2D::Filter2D() :
+	vertexPosAttrib_(0),
+	texelSizeUniform_(-1),
+	texelSize_(0.0f)
+{
+}
+
+Filter2D::Filter2D(const std::string& fragmentShader) :
+	program_(CreateProgram(CreateVertexShader(Filter2DVShader), CreateFragmentShader(fragmentShader))),
+	quadBuffer_(GLBuffer::Create()),
+	vertexPosAttrib_(0),
+	texelSizeUniform_(-1),
+	texelSize_(0.0f)
+{
+	const auto vertexPosAttrib = glGetAttribLocation(program_.GetHandle(), "vPosition");
+	ASSERT(vertexPosAttrib != -1);
+	vertexPosAttrib_ = vertexPosAttrib;
+
+	// not every filter samples neighbour texels
+	texelSizeUniform_ = glGetUniformLocation(program_.GetHandle(), "texelSize");
+
+	const float quad[] =
+	{
+		-1, -1,
+		-1, 1,
+		1, 1,
+
+		-1, -1,
+		1, 1,
+		1, -1
+	};
+	glBindBuffer(GL_ARRAY_BUFFER, quadBuffer_.GetHandle());
+	glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	GL_CHECK();
+}
+
+Filter2D::Uniform& Filter2D::GetUniform(const std::string& name)
+{
+	auto& uniform = uniforms_[name];
+	if (uniform.location == -1)
+	{
+		uniform.location = glGetUniformLocation(program_.GetHandle(), name.c_str());
+		ASSERT(uniform.location != -1);
+	}
+	return uniform;
+}
+
+// Uniforms belong to program, so they are uploaded with it in use.
+void Filter2D::SetUniform(const std::string& name, float value)
+{
+	auto& uniform = GetUniform(name);
+	if (uniform.valid && uniform.value.x == value)
+	{
+		return;
+	}
+
+	glUseProgram(program_.GetHandle());
+	glUniform1f(uniform.location, value);
+	uniform.value.x = value;
+	uniform.valid = true;
+}
+
+void Filter2D::SetUniform(const std::string& name, const glm::vec2& value)
+{
+	auto& uniform = GetUniform(name);
+	if (uniform.valid && uniform.value == value)
+	{
+		return;
+	}
+
+	glUseProgram(program_.GetHandle());
+	glUniform2fv(uniform.location, 1, glm::value_ptr(value));
+	uniform.value = value;
+	uniform.valid = true;
+}
+
+void Filter2D::SetTexture(const std::string& name, GLuint unit, const GLTexture& texture)
+{
+	auto& uniform = GetUniform(name);
+	if (!uniform.valid || uniform.value.x != unit)
+	{
+		glUseProgram(program_.GetHandle());
+		glUniform1i(uniform.location, unit);
+		uniform.value.x = static_cast<float>(unit);
+		uniform.valid = true;
+	}
+
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D, texture.GetHandle());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void Filter2D::Render(const GLTexture& texture, uint32_t width, uint32_t height)
+{
+	SetTexture("texture", 0, texture);
+
+	glUseProgram(program_.GetHandle());
+	const glm::vec2 texelSize(1.0f / width, 1.0f / height);
+	if (texelSizeUniform_ != -1 && texelSize != texelSize_)
+	{
+		glUniform2fv(texelSizeUniform_, 1, glm::value_ptr(texelSize));
+		texelSize_ = texelSize;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, quadBuffer_.GetHandle());
+	glVertexAttribPointer(vertexPosAttrib_, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+	glEnableVertexAttribArray(vertexPosAttrib_);
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	GL_CHECK();
+}
\ No newline at end of file
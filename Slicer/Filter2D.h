@@ -0,0 +1,45 @@
+#pragma once
+
+#include "GlContext.h"
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <string>
+#include <unordered_map>
+
+// Full screen 2D filter program (Filter2DVShader with given fragment shader).
+// Attribute & uniform locations are resolved once, quad is kept in vertex buffer
+// & uniforms are uploaded only when their values change.
+class Filter2D
+{
+public:
+	Filter2D();
+	explicit Filter2D(const std::string& fragmentShader);
+
+	void SetUniform(const std::string& name, float value);
+	void SetUniform(const std::string& name, const glm::vec2& value);
+	// binds texture (nearest filtering) to given unit & sets sampler uniform
+	void SetTexture(const std::string& name, GLuint unit, const GLTexture& texture);
+
+	// renders into current framebuffer, "texture" sampler is bound to unit 0
+	void Render(const GLTexture& texture, uint32_t width, uint32_t height);
+
+private:
+	struct Uniform
+	{
+		GLint location = -1;
+		glm::vec2 value = glm::vec2(0.0f);
+		bool valid = false;
+	};
+
+	Uniform& GetUniform(const std::string& name);
+
+	GLProgram program_;
+	GLBuffer quadBuffer_;
+	GLuint vertexPosAttrib_;
+	GLint texelSizeUniform_;
+	glm::vec2 texelSize_;
+
+	std::unordered_map<std::string, Uniform> uniforms_;
+};
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <GLHelpers.h>
 
 #include <cassert>
+#include <deque>
 #include <memory>
 #include <string>
 #include <vector>
@@ -14,8 +15,30 @@ struct IGlContext
 	virtual uint32_t GetSurfaceHeight() const = 0;
 
 	virtual std::vector<uint8_t> GetRaster() = 0;
+
+	// Asynchronous readback: copy of current image is started by RequestRaster & taken by ReceiveRaster
+	// later (after next image is rendered), rasters are received in request order.
+	// Several channels (images packed into R, G, B, A) are returned one raster after another.
+	// Default implementation reads back synchronously, for GLES2 without pixel buffer objects.
+	virtual void RequestRaster(uint32_t channels = 1)
+	{
+		CHECK(channels == 1);
+		requestedRasters_.push_back(GetRaster());
+	}
+
+	virtual std::vector<uint8_t> ReceiveRaster()
+	{
+		CHECK(!requestedRasters_.empty());
+		auto raster = std::move(requestedRasters_.front());
+		requestedRasters_.pop_front();
+		return raster;
+	}
 	virtual void SetRaster(const std::vector<uint8_t>& raster, uint32_t width, uint32_t height) = 0;
 
+	// Only given part of image is read back (pixels outside of it are returned black).
+	// Default implementation reads back whole image.
+	virtual void SetReadbackRect(uint32_t /*x*/, uint32_t /*y*/, uint32_t /*width*/, uint32_t /*height*/) {}
+
 	virtual void SwapBuffers() = 0;
 	virtual void ResetFBO() = 0;
 
@@ -23,6 +46,9 @@ struct IGlContext
 	virtual void Resolve(const GLFramebuffer& fboTo) = 0;
 
 	virtual ~IGlContext() {}
+
+protected:
+	std::deque<std::vector<uint8_t>> requestedRasters_;
 };
 
 class RasterSetter
@@ -41,4 +67,5 @@ private:
 };
 
 std::unique_ptr<IGlContext> CreateFullscreenGlContext(uint32_t width, uint32_t height, uint32_t samples);
-std::unique_ptr<IGlContext> CreateOffscreenGlContext(uint32_t width, uint32_t height, uint32_t samples);
\ No newline at end of file
+// channels: color channels used by renderer (single channel render target may be used when 1)
+std::unique_ptr<IGlContext> CreateOffscreenGlContext(uint32_t width, uint32_t height, uint32_t samples, uint32_t channels);
\ No newline at end of file
@@ -1,9 +1,9 @@
 #include "GlContextANGLE.h"
 
+#include <Raster.h>
+
 #include <egl/eglext.h>
 
-#include <d3d11.h>
-#include <atlbase.h>
 #pragma comment (lib, "d3d11.lib")
 
 #include <stdexcept>
@@ -16,15 +16,24 @@ namespace
 	void CheckRequiredGLExtensions();
 }
 
-GlContextANGLE::GlContextANGLE(uint32_t width, uint32_t height, uint32_t samples) :
+GlContextANGLE::GlContextANGLE(uint32_t width, uint32_t height, uint32_t samples, uint32_t channels) :
 width_(width),
-height_(height)
+height_(height),
+colorFormat_(GL_BGRA8_EXT),
+readbackBox_{ 0, 0, 0, width, height, 1 },
+readbackSlots_(ReadbackSlotsCount),
+nextReadbackSlot_(0)
 {
 	if (width == 0 || height == 0)
 	{
 		throw std::runtime_error("Invalid render target size");
 	}
 
+	if (channels == 0 || channels > 4)
+	{
+		throw std::runtime_error("Invalid render target channels count");
+	}
+
 	gl_.display = eglGetDisplay(EGL_D3D11_ONLY_DISPLAY_ANGLE);
 	if (!gl_.display)
 	{
@@ -93,11 +102,18 @@ height_(height)
 	}
 
 	CheckRequiredGLExtensions();
+
+	// only first channel is used, so single channel targets cut readback 4x
+	if (channels == 1 && IsGLExtensionSupported("GL_EXT_texture_rg"))
+	{
+		colorFormat_ = GL_R8_EXT;
+	}
 	CreateMultisampledFBO(width_, height_, samples);
 
 	glBindFramebuffer(GL_FRAMEBUFFER, gl_.fbo.GetHandle());
 
 	rasterSetter_ = std::make_unique<RasterSetter>();
+	QueryD3DDevice();
 }
 
 GlContextANGLE::GLData::~GLData()
@@ -160,18 +176,15 @@ std::vector<uint8_t> GlContextANGLE::GetRasterGLES()
 	GL_CHECK();
 
 	std::vector<uint8_t> retVal(GetSurfaceWidth() * GetSurfaceHeight());
-	for (auto i = 0u; i < tempPixelBuffer.size(); i += FBOBytesPerPixel)
-	{
-		retVal[i / FBOBytesPerPixel] = tempPixelBuffer[i];
-	}
+	ExtractFirstChannel(tempPixelBuffer.data(), GetSurfaceWidth() * FBOBytesPerPixel,
+		GetSurfaceWidth(), GetSurfaceHeight(), retVal.data());
 
 	glBindFramebuffer(GL_FRAMEBUFFER, currentFBO);
 	return retVal;
 }
 
-// All extraction & manipulation with underlying d3d11 device here is for performance
-// (about 2x faster than glReadPixels on ANGLE).
-std::vector<uint8_t> GlContextANGLE::GetRaster()
+// Device & immediate context live as long as egl display, so they are queried once.
+void GlContextANGLE::QueryD3DDevice()
 {
 	auto queryDisplayAttribEXT =
 		(PFNEGLQUERYDISPLAYATTRIBEXTPROC)eglGetProcAddress("eglQueryDisplayAttribEXT");
@@ -184,21 +197,20 @@ std::vector<uint8_t> GlContextANGLE::GetRaster()
 	CHECK(queryDeviceAttribEXT(reinterpret_cast<EGLDeviceEXT>(angleDevice),
 		EGL_D3D11_DEVICE_ANGLE, &d3d11Device));
 
-	CComPtr<ID3D11Device> device(reinterpret_cast<ID3D11Device*>(d3d11Device));
-
-	CComPtr<ID3D11DeviceContext> context;
-	device->GetImmediateContext(&context);
+	d3dDevice_ = reinterpret_cast<ID3D11Device*>(d3d11Device);
+	d3dDevice_->GetImmediateContext(&d3dContext_);
+}
 
+// Queues copy of current render target to staging texture, (re)creating textures when target has changed.
+void GlContextANGLE::CopyRenderTarget(ReadbackSlot& slot)
+{
 	CComPtr<ID3D11RenderTargetView> rtView;
-	context->OMGetRenderTargets(1, &rtView, nullptr);
+	d3dContext_->OMGetRenderTargets(1, &rtView, nullptr);
 	CHECK(rtView != nullptr);
 
 	CComPtr<ID3D11Resource> rtResource;
 	rtView->GetResource(&rtResource);
 
-	CComPtr<ID3D11Texture2D> resolveTarget;
-	CComPtr<ID3D11Texture2D> sysmemTarget;
-
 	CComQIPtr<ID3D11Texture2D> rtTexture(rtResource);
 	D3D11_TEXTURE2D_DESC rtDesc;
 	rtTexture->GetDesc(&rtDesc);
@@ -206,35 +218,128 @@ std::vector<uint8_t> GlContextANGLE::GetRaster()
 	rtDesc.BindFlags = 0;
 	rtDesc.SampleDesc.Count = 1;
 	rtDesc.SampleDesc.Quality = 0;
-	CHECK(SUCCEEDED(device->CreateTexture2D(&rtDesc, nullptr, &resolveTarget)));
-	context->ResolveSubresource(resolveTarget, 0, rtTexture, 0, rtDesc.Format);
 
-	rtDesc.Usage = D3D11_USAGE_STAGING;
-	rtDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
-	CHECK(SUCCEEDED(device->CreateTexture2D(&rtDesc, nullptr, &sysmemTarget)));
-	context->CopyResource(sysmemTarget, resolveTarget);
+	D3D11_TEXTURE2D_DESC slotDesc = {};
+	if (slot.stagingTarget)
+	{
+		slot.stagingTarget->GetDesc(&slotDesc);
+	}
+
+	if (!slot.stagingTarget || slotDesc.Width != rtDesc.Width || slotDesc.Height != rtDesc.Height || slotDesc.Format != rtDesc.Format)
+	{
+		slot.resolveTarget.Release();
+		slot.stagingTarget.Release();
+
+		CHECK(SUCCEEDED(d3dDevice_->CreateTexture2D(&rtDesc, nullptr, &slot.resolveTarget)));
+
+		rtDesc.Usage = D3D11_USAGE_STAGING;
+		rtDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+		CHECK(SUCCEEDED(d3dDevice_->CreateTexture2D(&rtDesc, nullptr, &slot.stagingTarget)));
+	}
+
+	d3dContext_->ResolveSubresource(slot.resolveTarget, 0, rtTexture, 0, rtDesc.Format);
 
-	std::vector<uint8_t> result(rtDesc.Width * rtDesc.Height);
+	slot.box = readbackBox_;
+	if (slot.box.right - slot.box.left == rtDesc.Width && slot.box.bottom - slot.box.top == rtDesc.Height)
+	{
+		d3dContext_->CopyResource(slot.stagingTarget, slot.resolveTarget);
+	}
+	else if (slot.box.right > slot.box.left && slot.box.bottom > slot.box.top)
+	{
+		d3dContext_->CopySubresourceRegion(slot.stagingTarget, 0, slot.box.left, slot.box.top, 0, slot.resolveTarget, 0, &slot.box);
+	}
+}
+
+// Map waits for queued copy to complete.
+std::vector<uint8_t> GlContextANGLE::ExtractRaster(ReadbackSlot& slot)
+{
+	D3D11_TEXTURE2D_DESC desc;
+	slot.stagingTarget->GetDesc(&desc);
+
+	// only copied part is extracted, the rest of image is black
+	const size_t imageSize = desc.Width * desc.Height;
+	std::vector<uint8_t> result(imageSize * slot.channels, 0);
+
+	const auto& box = slot.box;
+	if (box.right <= box.left || box.bottom <= box.top)
+	{
+		return result;
+	}
+	const auto boxWidth = box.right - box.left;
 
 	D3D11_MAPPED_SUBRESOURCE mapInfo;
-	CHECK(SUCCEEDED(context->Map(sysmemTarget, 0, D3D11_MAP_READ, 0, &mapInfo)));
-	const auto TextureBytesPerPixel = 4;
-	for (size_t y = 0; y < rtDesc.Height; ++y)
+	CHECK(SUCCEEDED(d3dContext_->Map(slot.stagingTarget, 0, D3D11_MAP_READ, 0, &mapInfo)));
+	const auto pixels = reinterpret_cast<const uint8_t*>(mapInfo.pData);
+	if (desc.Format == DXGI_FORMAT_R8_UNORM)
+	{
+		for (size_t y = box.top; y < box.bottom; ++y)
+		{
+			const auto row = pixels + mapInfo.RowPitch * y + box.left;
+			std::copy(row, row + boxWidth, &result[desc.Width * y + box.left]);
+		}
+	}
+	else
 	{
-		for (size_t x = 0; x < rtDesc.Width; ++x)
+		// GL red, green, blue & alpha bytes in BGRA pixel
+		const auto BytesPerPixel = 4;
+		const uint32_t ChannelBytes[] = { 2, 1, 0, 3 };
+		for (uint32_t channel = 0; channel < slot.channels; ++channel)
 		{
-			result[rtDesc.Width*y + x] = reinterpret_cast<const uint8_t*>(mapInfo.pData)[mapInfo.RowPitch*y + x*TextureBytesPerPixel];
+			for (size_t y = box.top; y < box.bottom; ++y)
+			{
+				ExtractChannel(pixels + mapInfo.RowPitch * y + box.left * BytesPerPixel, mapInfo.RowPitch, ChannelBytes[channel],
+					boxWidth, 1, &result[imageSize * channel + desc.Width * y + box.left]);
+			}
 		}
 	}
-	context->Unmap(sysmemTarget, 0);
+	d3dContext_->Unmap(slot.stagingTarget, 0);
 	return result;
 }
 
+// All extraction & manipulation with underlying d3d11 device here is for performance
+// (about 2x faster than glReadPixels on ANGLE).
+std::vector<uint8_t> GlContextANGLE::GetRaster()
+{
+	CopyRenderTarget(rasterSlot_);
+	return ExtractRaster(rasterSlot_);
+}
+
+// Staging textures ring: copy of one image is in flight while the next one is rendered.
+void GlContextANGLE::RequestRaster(uint32_t channels)
+{
+	CHECK(pendingReadbacks_.size() < readbackSlots_.size());
+	CHECK(channels == 1 || colorFormat_ != GL_R8_EXT);
+
+	const auto slot = nextReadbackSlot_;
+	nextReadbackSlot_ = (nextReadbackSlot_ + 1) % readbackSlots_.size();
+
+	readbackSlots_[slot].channels = channels;
+	CopyRenderTarget(readbackSlots_[slot]);
+	pendingReadbacks_.push_back(slot);
+}
+
+std::vector<uint8_t> GlContextANGLE::ReceiveRaster()
+{
+	CHECK(!pendingReadbacks_.empty());
+
+	const auto slot = pendingReadbacks_.front();
+	pendingReadbacks_.pop_front();
+	return ExtractRaster(readbackSlots_[slot]);
+}
+
 void GlContextANGLE::SetRaster(const std::vector<uint8_t>& raster, uint32_t width, uint32_t height)
 {
 	rasterSetter_->SetRaster(raster, width, height);
 }
 
+void GlContextANGLE::SetReadbackRect(uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+	readbackBox_.left = std::min(x, width_);
+	readbackBox_.top = std::min(y, height_);
+	readbackBox_.right = std::min(x + width, width_);
+	readbackBox_.bottom = std::min(y + height, height_);
+}
+
 void GlContextANGLE::SwapBuffers()
 {
 	Blit(gl_.fbo, GLFramebuffer(0));
@@ -261,7 +366,7 @@ void GlContextANGLE::CreateMultisampledFBO(uint32_t width, uint32_t height, uint
 {
 	gl_.renderBuffer = GLRenderbuffer::Create();
 	glBindRenderbuffer(GL_RENDERBUFFER, gl_.renderBuffer.GetHandle());
-	glRenderbufferStorageMultisampleANGLE(GL_RENDERBUFFER, samples, GL_BGRA8_EXT, width, height);
+	glRenderbufferStorageMultisampleANGLE(GL_RENDERBUFFER, samples, colorFormat_, width, height);
 	GL_CHECK();
 
 	gl_.renderBufferDepth = GLRenderbuffer::Create();
@@ -283,7 +388,7 @@ void GlContextANGLE::CreateTextureFBO(uint32_t width, uint32_t height, GLFramebu
 {
 	texture = GLTexture::Create();
 	glBindTexture(GL_TEXTURE_2D, texture.GetHandle());
-	glTexStorage2DEXT(GL_TEXTURE_2D, 1, GL_BGRA8_EXT, width, height);
+	glTexStorage2DEXT(GL_TEXTURE_2D, 1, colorFormat_, width, height);
 	GL_CHECK();
 
 	fbo = GLFramebuffer::Create();
@@ -316,9 +421,9 @@ std::unique_ptr<IGlContext> CreateFullscreenGlContext(uint32_t width, uint32_t h
 	throw std::runtime_error(__FUNCTION__" not implemented");
 }
 
-std::unique_ptr<IGlContext> CreateOffscreenGlContext(uint32_t width, uint32_t height, uint32_t samples)
+std::unique_ptr<IGlContext> CreateOffscreenGlContext(uint32_t width, uint32_t height, uint32_t samples, uint32_t channels)
 {
-	return std::make_unique<GlContextANGLE>(width, height, samples);
+	return std::make_unique<GlContextANGLE>(width, height, samples, channels);
 }
 
 namespace
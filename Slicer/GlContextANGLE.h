@@ -4,10 +4,15 @@
 
 #include <EGL/egl.h>
 
+#include <d3d11.h>
+#include <atlbase.h>
+
+#include <deque>
+
 class GlContextANGLE : public IGlContext
 {
 public:
-	GlContextANGLE(uint32_t width, uint32_t height, uint32_t samples);
+	GlContextANGLE(uint32_t width, uint32_t height, uint32_t samples, uint32_t channels);
 	~GlContextANGLE();
 private:
 
@@ -17,7 +22,10 @@ private:
 	void SwapBuffers() override;
 	std::vector<uint8_t> GetRaster() override;
 	std::vector<uint8_t> GetRasterGLES();
+	void RequestRaster(uint32_t channels = 1) override;
+	std::vector<uint8_t> ReceiveRaster() override;
 	void SetRaster(const std::vector<uint8_t>& raster, uint32_t width, uint32_t height) override;
+	void SetReadbackRect(uint32_t x, uint32_t y, uint32_t width, uint32_t height) override;
 
 	void CreateTextureFBO(GLFramebuffer& fbo, GLTexture& texture) override;
 	void Resolve(const GLFramebuffer& fboTo) override;
@@ -28,6 +36,19 @@ private:
 
 	void CreateMultisampledFBO(uint32_t width, uint32_t height, uint32_t samples);
 	void CreateTextureFBO(uint32_t width, uint32_t height, GLFramebuffer& fbo, GLTexture& texture);
+
+	struct ReadbackSlot
+	{
+		CComPtr<ID3D11Texture2D> resolveTarget;
+		CComPtr<ID3D11Texture2D> stagingTarget;
+		uint32_t channels = 1;
+		// part of image copied to staging texture
+		D3D11_BOX box = {};
+	};
+
+	void QueryD3DDevice();
+	void CopyRenderTarget(ReadbackSlot& slot);
+	std::vector<uint8_t> ExtractRaster(ReadbackSlot& slot);
 	
 
 	struct GLData
@@ -50,6 +71,22 @@ private:
 	GLData gl_;
 	uint32_t width_;
 	uint32_t height_;
+	// R8 when supported, BGRA8 otherwise
+	GLenum colorFormat_;
 
 	std::unique_ptr<RasterSetter> rasterSetter_;
+
+	CComPtr<ID3D11Device> d3dDevice_;
+	CComPtr<ID3D11DeviceContext> d3dContext_;
+
+	D3D11_BOX readbackBox_;
+
+	// staging textures are kept between frames & recreated only when render target changes
+	ReadbackSlot rasterSlot_;
+
+	// double buffering: one readback in flight while next image is rendered
+	static const size_t ReadbackSlotsCount = 2;
+	std::vector<ReadbackSlot> readbackSlots_;
+	std::deque<size_t> pendingReadbacks_;
+	size_t nextReadbackSlot_;
 };
\ No newline at end of file
@@ -165,10 +165,8 @@ std::vector<uint8_t> GlContextRPi::GetRaster()
 	GL_CHECK();
 
 	std::vector<uint8_t> retVal(GetSurfaceWidth() * GetSurfaceHeight());
-	for (auto i = 0u; i < tempPixelBuffer_.size(); i += FBOBytesPerPixel)
-	{
-		retVal[i / FBOBytesPerPixel] = tempPixelBuffer_[i];
-	}
+	ExtractFirstChannel(tempPixelBuffer_.data(), GetSurfaceWidth() * FBOBytesPerPixel,
+		GetSurfaceWidth(), GetSurfaceHeight(), retVal.data());
 
 	/*CRUTCH: RPi have GL driver bugs, leaving junk pixels*/
 	decltype(retVal) temp(retVal.size());
@@ -190,7 +188,7 @@ std::unique_ptr<IGlContext> CreateFullscreenGlContext(uint32_t width, uint32_t h
 	return std::unique_ptr<GlContextRPi>(new GlContextRPi(width, height, samples));
 }
 
-std::unique_ptr<IGlContext> CreateOffscreenGlContext(uint32_t width, uint32_t height, uint32_t samples)
+std::unique_ptr<IGlContext> CreateOffscreenGlContext(uint32_t width, uint32_t height, uint32_t samples, uint32_t channels)
 {
 	assert(false);
 	throw std::runtime_error(std::string(__func__) + ": not implemented");
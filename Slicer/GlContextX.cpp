@@ -1,5 +1,7 @@
 #include "GlContextX.h"
 
+#include <Raster.h>
+
 #include <stdexcept>
 #include <cassert>
 #include <cstring>
@@ -146,10 +148,8 @@ std::vector<uint8_t> GlContextX::GetRaster()
 	GL_CHECK();
 
 	std::vector<uint8_t> retVal(GetSurfaceWidth() * GetSurfaceHeight());
-	for (auto i = 0u; i < tempPixelBuffer_.size(); i += FBOBytesPerPixel)
-	{
-		retVal[i / FBOBytesPerPixel] = tempPixelBuffer_[i];
-	}
+	ExtractFirstChannel(tempPixelBuffer_.data(), GetSurfaceWidth() * FBOBytesPerPixel,
+		GetSurfaceWidth(), GetSurfaceHeight(), retVal.data());
 
 	return retVal;
 }
@@ -205,7 +205,7 @@ std::unique_ptr<IGlContext> CreateFullscreenGlContext(uint32_t width, uint32_t h
 	return std::unique_ptr<GlContextX>(new GlContextX(width, height, samples));	
 }
 
-std::unique_ptr<IGlContext> CreateOffscreenGlContext(uint32_t width, uint32_t height, uint32_t samples)
+std::unique_ptr<IGlContext> CreateOffscreenGlContext(uint32_t width, uint32_t height, uint32_t samples, uint32_t channels)
 {
 	assert(false);
 	throw std::runtime_error(std::string(__func__) + ": not implemented");
@@ -11,6 +11,8 @@
 #include <PngFile.h>
 #include <Loaders.h>
 #include <Raster.h>
+#include <RunRaster.h>
+#include <RasterKernels.h>
 #include <PerfTimer.h>
 #include <Geometry.h>
 
@@ -31,13 +33,20 @@
 
 namespace
 {
-	bool HasOverhangs(const std::vector<uint8_t>& raster, uint32_t width, uint32_t height);
+	// ERM image is rendered with model shifted by half pixel
+	const glm::vec2 ErmShift(0.5f, 0.5f);
 } //namespace
 
-
 Renderer::Renderer(const Settings& settings) :
 settings_(settings),
 modelOffset_(0,0),
+renderedModelOffset_(0,0),
+ermShift_(0,0),
+bandOrigin_(0),
+smallSpotsMaskValid_(false),
+smallSpotsMaskOffset_(0,0),
+smallSpotsMaskOnGpu_(false),
+scissorRect_(0,0,0,0),
 
 mainVertexPosAttrib_(0),
 mainVertexNormalAttrib_(0),
@@ -51,15 +60,77 @@ maskWVPTransformUniform_(0),
 maskTextureUniform_(0),
 maskPlateSizeUniform_(0),
 
-palette_(CreateGrayscalePalette())
+islandAreaPixelAttrib_(0),
+islandAreaTexelSizeUniform_(0),
+islandAreaLabelTextureUniform_(0),
+islandAreaCoverageTextureUniform_(0),
+islandAreaPixelWeightUniform_(0),
+
+gpuSmallSpots_(false),
+uintIndices_(false),
+palette_(CreateGrayscalePalette()),
+sliceReused_(false),
+overhangsLayer_(-1)
 {
+	if (settings_.outputFormat != "png" && settings_.outputFormat != "svg" && settings_.outputFormat != "cli")
+	{
+		throw std::runtime_error("Unknown output format: " + settings_.outputFormat);
+	}
+
+	if (IsVectorOutput() && (!settings_.offscreen || settings_.IsBanded() || settings_.doInflate || settings_.doSmallSpotsProcessing ||
+		settings_.doOverhangAnalysis || settings_.enableERM))
+	{
+		throw std::runtime_error("Vector output supports only offscreen mode without inflate, small spots, overhangs & ERM processing");
+	}
+
+	// CPU rendering processes small spots by contours, GL rendering needs whole image
+	if (settings_.IsBanded() && (!settings_.offscreen || settings_.doOverhangAnalysis ||
+		(settings_.doSmallSpotsProcessing && !settings_.cpuRendering)))
+	{
+		throw std::runtime_error("Banded rendering supports only offscreen mode without overhangs analysis & GL small spots processing");
+	}
+
+	if (settings_.supportKernel != "square" && settings_.supportKernel != "circle")
+	{
+		throw std::runtime_error("Unknown support kernel: " + settings_.supportKernel);
+	}
+
+	// packed images are read back as a whole, so nothing may be read back between them
+	if (settings_.packedSlices == 0 || settings_.packedSlices > 4)
+	{
+		throw std::runtime_error("Packed slices count should be from 1 to 4");
+	}
+
+	if (settings_.packedSlices > 1 && (!settings_.offscreen || settings_.cpuRendering || settings_.IsBanded() ||
+		settings_.doSmallSpotsProcessing || IsGpuOverhangs()))
+	{
+		throw std::runtime_error("Packed slices are supported only with offscreen GL rendering without small spots & GPU overhangs processing");
+	}
+
+	// GPU overhangs are rendered from GL image
+	if (IsGpuOverhangs() && settings_.cpuRendering)
+	{
+		throw std::runtime_error("GPU overhangs analysis is not supported with CPU rendering");
+	}
+
+	// GL inflate & small spots re-render offset mesh, so image depends on triangles within inflate distance
+	// from slice plane, while slices are compared by triangles crossing it
+	if (settings_.reuseSlices && !settings_.cpuRendering && (settings_.doInflate || settings_.doSmallSpotsProcessing))
+	{
+		BOOST_LOG_TRIVIAL(info) << "Slices reuse is off with GL inflate & small spots processing";
+		settings_.reuseSlices = false;
+	}
+
+	// CPU rendering antialiases by itself, GL is used for postprocessing & display only
+	const auto glSamples = settings_.cpuRendering ? 0 : settings_.samples;
+	const auto surfaceHeight = settings_.IsBanded() ? settings_.bandHeight : settings_.renderHeight;
 	if (settings_.offscreen)
 	{
-		glContext_ = CreateOffscreenGlContext(settings_.renderWidth, settings_.renderHeight, settings_.samples);
+		glContext_ = CreateOffscreenGlContext(settings_.renderWidth, surfaceHeight, glSamples, settings_.packedSlices);
 	}
 	else
 	{
-		glContext_ = CreateFullscreenGlContext(settings_.renderWidth, settings_.renderHeight, settings_.samples);
+		glContext_ = CreateFullscreenGlContext(settings_.renderWidth, surfaceHeight, glSamples);
 	}
 
 	mainProgram_ = CreateProgram(CreateVertexShader(VShader), CreateFragmentShader(FShader));
@@ -88,20 +159,46 @@ palette_(CreateGrayscalePalette())
 	ASSERT(maskVertexPosAttrib_ != -1);
 	GL_CHECK();
 
-	omniDilateProgram_ = CreateProgram(CreateVertexShader(Filter2DVShader), CreateFragmentShader(OmniDilateFShader));
-	differenceProgram_ = CreateProgram(CreateVertexShader(Filter2DVShader), CreateFragmentShader(DifferenceFShader));
-	combineMaxProgram_ = CreateProgram(CreateVertexShader(Filter2DVShader), CreateFragmentShader(CombineMaxFShader));
+	maxFilter_ = Filter2D(MaxFilterFShader);
+	differenceFilter_ = Filter2D(DifferenceFShader);
+	combineMaxFilter_ = Filter2D(CombineMaxFShader);
 	
 	whiteTexture_ = GLTexture::Create();
 	maskTexture_ = GLTexture::Create();
 
 	glContext_->CreateTextureFBO(imageFBO_, imageTexture_);
-	glContext_->CreateTextureFBO(previousLayerImageFBO_, previousLayerImageTexture_);
-	White();
-	glContext_->Resolve(previousLayerImageFBO_);
+	if (IsGpuOverhangs())
+	{
+		// the first layer stands on platform
+		glContext_->CreateTextureFBO(previousLayerImageFBO_, previousLayerImageTexture_);
+		White();
+		glContext_->Resolve(previousLayerImageFBO_);
+	}
 	glContext_->CreateTextureFBO(temporaryFBO_, temporaryTexture_);
 	GL_CHECK();
 
+	// CPU rendering processes small spots by contours, GL rendering falls back to CPU labelling
+	// of read back image when GPU one is not supported
+	gpuSmallSpots_ = settings_.doSmallSpotsProcessing && !settings_.cpuRendering && IsGpuSmallSpotsSupported();
+	if (settings_.doSmallSpotsProcessing && !settings_.cpuRendering)
+	{
+		BOOST_LOG_TRIVIAL(info) << "Small spots processing: " << (gpuSmallSpots_ ? "GPU" : "CPU");
+	}
+	if (settings_.cpuRendering || (settings_.doSmallSpotsProcessing && !gpuSmallSpots_))
+	{
+		BOOST_LOG_TRIVIAL(info) << "Raster kernels: " << GetRasterKernelsInstructionSet();
+	}
+
+	if ((IsGpuOverhangs() && settings_.supportKernel == "circle") || gpuSmallSpots_)
+	{
+		CreateSeedTargets();
+	}
+
+	if (gpuSmallSpots_)
+	{
+		CreateSmallSpotsTargets();
+	}
+
 	const uint32_t WhiteOpaquePixel = 0xFFFFFFFF;
 	glBindTexture(GL_TEXTURE_2D, whiteTexture_.GetHandle());
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, &WhiteOpaquePixel);
@@ -113,14 +210,32 @@ palette_(CreateGrayscalePalette())
 	glDepthFunc(GL_ALWAYS);
 	glDepthMask(GL_TRUE);
 
+	uintIndices_ = IsGLExtensionSupported("GL_OES_element_index_uint");
 	CreateGeometryBuffers();
 }
 
+// Rendering ends with WaitForSaving, so images are left in flight only by an error.
 Renderer::~Renderer()
 {
+	try
+	{
+		while (!pendingReadbacks_.empty())
+		{
+			ReceiveReadback();
+		}
+	}
+	catch (...)
+	{
+	}
+
 	for (auto& v : pngSaveResult_)
 	{
-		v.get();
+		v.wait();
+	}
+
+	if (bandWriteResult_.valid())
+	{
+		bandWriteResult_.wait();
 	}
 }
 
@@ -130,43 +245,107 @@ void Renderer::CreateGeometryBuffers()
 	model_.min = glm::vec3(std::numeric_limits<float>::max());
 	model_.max = glm::vec3(std::numeric_limits<float>::lowest());
 
-	LoadModel(settings_.modelFile,
-		[this](const std::vector<float>& vb, const std::vector<float>& nb, const std::vector<uint16_t>& ib) {
+	if (settings_.cpuRendering || IsVectorOutput())
+	{
+		CreateSlicingMesh();
+	}
+	else
+	{
+		// chunks are packed into few large buffers, indices of chunk are rebased to its batch
+		// when 32-bit indices are supported (then adjacent chunks are drawn at once)
+		std::vector<float> batchVb;
+		std::vector<float> batchNb;
+		std::vector<uint16_t> batchIb16;
+		std::vector<uint32_t> batchIb32;
+
+		const auto flushBatch = [&]() {
+			if (batchVb.empty())
+			{
+				return;
+			}
+
+			GeometryBatch batch{ GLBuffer::Create(), GLBuffer::Create(), GLBuffer::Create() };
 
-		auto vertexBuffer = GLBuffer::Create();
-		auto normalBuffer = GLBuffer::Create();
-		auto indexBuffer = GLBuffer::Create();
+			glBindBuffer(GL_ARRAY_BUFFER, batch.vertices.GetHandle());
+			glBufferData(GL_ARRAY_BUFFER, batchVb.size() * sizeof(batchVb[0]), batchVb.data(), GL_STATIC_DRAW);
 
-		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer.GetHandle());
-		glBufferData(GL_ARRAY_BUFFER, vb.size() * sizeof(vb[0]), vb.data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_ARRAY_BUFFER, batch.normals.GetHandle());
+			glBufferData(GL_ARRAY_BUFFER, batchNb.size() * sizeof(batchNb[0]), batchNb.data(), GL_STATIC_DRAW);
 
-		glBindBuffer(GL_ARRAY_BUFFER, normalBuffer.GetHandle());
-		glBufferData(GL_ARRAY_BUFFER, nb.size() * sizeof(nb[0]), nb.data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.indices.GetHandle());
+			if (uintIndices_)
+			{
+				glBufferData(GL_ELEMENT_ARRAY_BUFFER, batchIb32.size() * sizeof(batchIb32[0]), batchIb32.data(), GL_STATIC_DRAW);
+			}
+			else
+			{
+				glBufferData(GL_ELEMENT_ARRAY_BUFFER, batchIb16.size() * sizeof(batchIb16[0]), batchIb16.data(), GL_STATIC_DRAW);
+			}
+			GL_CHECK();
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer.GetHandle());
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, ib.size() * sizeof(ib[0]), ib.data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+			this->batches_.push_back(std::move(batch));
+			batchVb.clear();
+			batchNb.clear();
+			batchIb16.clear();
+			batchIb32.clear();
+		};
+
+		LoadModel(settings_.modelFile,
+			[&](const std::vector<float>& vb, const std::vector<float>& nb, const std::vector<uint16_t>& ib) {
+
+			const size_t MaxBatchVertices = 2 * 1024 * 1024;
+			if ((batchVb.size() + vb.size()) / 3 > MaxBatchVertices)
+			{
+				flushBatch();
+			}
 
-		this->vBuffers_.push_back(std::move(vertexBuffer));
-		this->nBuffers_.push_back(std::move(normalBuffer));
-		this->iBuffers_.push_back(std::move(indexBuffer));
+			MeshInfo info;
+			info.batch = this->batches_.size();
+			info.vertexOffset = batchVb.size() * sizeof(batchVb[0]);
+			if (uintIndices_)
+			{
+				const auto baseVertex = static_cast<uint32_t>(batchVb.size() / 3);
+				info.indexOffset = batchIb32.size() * sizeof(batchIb32[0]);
+				for (const auto index : ib)
+				{
+					batchIb32.push_back(baseVertex + index);
+				}
+			}
+			else
+			{
+				info.indexOffset = batchIb16.size() * sizeof(batchIb16[0]);
+				batchIb16.insert(batchIb16.end(), ib.begin(), ib.end());
+			}
+			batchVb.insert(batchVb.end(), vb.begin(), vb.end());
+			batchNb.insert(batchNb.end(), nb.begin(), nb.end());
 
-		glm::vec3 meshMin(std::numeric_limits<float>::max());
-		glm::vec3 meshMax(std::numeric_limits<float>::lowest());
-		for (auto i = 0u; i < vb.size(); i += 3)
+			glm::vec3 meshMin(std::numeric_limits<float>::max());
+			glm::vec3 meshMax(std::numeric_limits<float>::lowest());
+			for (auto i = 0u; i < vb.size(); i += 3)
+			{
+				const auto& vertexPosition = *reinterpret_cast<const glm::vec3*>(&vb[i + 0]);
+				meshMin = glm::min(meshMin, vertexPosition);
+				meshMax = glm::max(meshMax, vertexPosition);
+			}
+			info.idxCount = static_cast<GLsizei>(ib.size());
+			info.zMin = meshMin.z;
+			info.zMax = meshMax.z;
+			this->meshInfo_.push_back(info);
+
+			model_.min = glm::min(model_.min, meshMin);
+			model_.max = glm::max(model_.max, meshMax);
+		});
+		flushBatch();
+
+		// slicing mesh detects identical slices for GL rendering too (at the cost of extra mesh copy)
+		if (settings_.reuseSlices)
 		{
-			const auto& vertexPosition = *reinterpret_cast<const glm::vec3*>(&vb[i + 0]);
-			meshMin = glm::min(meshMin, vertexPosition);
-			meshMax = glm::max(meshMax, vertexPosition);
+			CreateSlicingMesh();
 		}
-		MeshInfo info;
-		info.idxCount = static_cast<GLsizei>(ib.size());
-		info.zMin = meshMin.z;
-		info.zMax = meshMax.z;
-		this->meshInfo_.push_back(info);
-
-		model_.min = glm::min(model_.min, meshMin);
-		model_.max = glm::max(model_.max, meshMax);
-	});
+	}
 	model_.pos = model_.min.z;
 
 	const auto extent = model_.max - model_.min;
@@ -176,9 +355,26 @@ void Renderer::CreateGeometryBuffers()
 	}
 
 	BOOST_LOG_TRIVIAL(info) << "Split parts: " << meshInfo_.size();
+	BOOST_LOG_TRIVIAL(info) << "Geometry batches: " << batches_.size();
 	BOOST_LOG_TRIVIAL(info) << "Model dimensions: " << extent.x << " x " << extent.y << " x " << extent.z;
 }
 
+void Renderer::CreateSlicingMesh()
+{
+	std::vector<float> vb;
+	std::vector<uint32_t> ib;
+	LoadMesh(settings_.modelFile, vb, ib);
+
+	meshSlicer_.reset(new MeshSlicer(vb, ib));
+	model_.min = meshSlicer_->GetMin();
+	model_.max = meshSlicer_->GetMax();
+
+	if (settings_.cpuRendering)
+	{
+		rasterizer_.reset(new CoverageRasterizer(glContext_->GetSurfaceWidth(), glContext_->GetSurfaceHeight()));
+	}
+}
+
 uint32_t Renderer::GetLayersCount() const
 {
 	return static_cast<uint32_t>((model_.max.z - model_.min.z) / settings_.step + 0.5f);
@@ -187,6 +383,7 @@ uint32_t Renderer::GetLayersCount() const
 void Renderer::FirstSlice()
 {
 	model_.pos = model_.min.z + settings_.step/2;
+	Slice();
 	Render();
 }
 
@@ -197,13 +394,14 @@ bool Renderer::NextSlice()
 	{
 		return false;
 	}
+	Slice();
 	Render();
 	return true;
 }
 
 void Renderer::White()
 {
-	glViewport(0, 0, settings_.renderWidth, settings_.renderHeight);
+	glViewport(0, 0, glContext_->GetSurfaceWidth(), glContext_->GetSurfaceHeight());
 
 	glClearColor(1.0, 1.0, 1.0, 1.0);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
@@ -215,8 +413,68 @@ void Renderer::White()
 	}
 }
 
+void Renderer::Slice()
+{
+	if (meshSlicer_)
+	{
+		meshSlicer_->Slice(model_.pos, sliceEdges_);
+	}
+
+	// banded images are streamed, so there is nothing to keep
+	sliceReused_ = settings_.reuseSlices && !settings_.IsBanded() && meshSlicer_ && meshSlicer_->IsSameAsPrevious();
+	if (!sliceReused_)
+	{
+		sliceImages_.clear();
+	}
+
+	// offset edges are in model space, so they are shared by normal & ERM images
+	// & stay valid while cross section is the same
+	if (settings_.cpuRendering && !meshSlicer_->IsSameAsPrevious())
+	{
+		CalculateOffsetEdges();
+	}
+	smallSpotsMaskValid_ = false;
+}
+
+const Renderer::SliceImage* Renderer::FindSliceImage() const
+{
+	for (const auto& image : sliceImages_)
+	{
+		if (image.modelOffset == renderedModelOffset_)
+		{
+			return &image;
+		}
+	}
+	return nullptr;
+}
+
+bool Renderer::IsSliceReused() const
+{
+	return sliceReused_;
+}
+
 void Renderer::Render()
 {
+	renderedModelOffset_ = modelOffset_;
+
+	if (IsVectorOutput())
+	{
+		SliceContours();
+		return;
+	}
+
+	// previous slice image is saved again
+	if (FindSliceImage())
+	{
+		return;
+	}
+
+	// bands are rendered by SavePng
+	if (settings_.IsBanded())
+	{
+		return;
+	}
+
 	if (!settings_.offscreen)
 	{
 		RenderFullscreen();
@@ -229,8 +487,13 @@ void Renderer::Render()
 
 glm::mat4x4 Renderer::CalculateModelTransform() const
 {
-	const auto offsetX = (settings_.plateWidth / settings_.renderWidth) * modelOffset_.x;
-	const auto offsetY = (settings_.plateHeight / settings_.renderHeight) * modelOffset_.y;
+	return CalculateModelTransform(modelOffset_);
+}
+
+glm::mat4x4 Renderer::CalculateModelTransform(const glm::vec2& modelOffset) const
+{
+	const auto offsetX = (settings_.plateWidth / settings_.renderWidth) * modelOffset.x;
+	const auto offsetY = (settings_.plateHeight / settings_.renderHeight) * modelOffset.y;
 
 	return scale(glm::vec3(1.0f, 1.0f, 1.0f)) * translate(glm::vec3(offsetX, offsetY, 0.0f));
 }
@@ -263,6 +526,31 @@ glm::mat4x4 Renderer::CalculateProjectionTransform() const
 		0.0f, extent.z);
 }
 
+// Maps image rows [bandOrigin_, bandOrigin_ + surface height) onto the whole surface.
+// Applied to clip coordinates, so mirror done by shader afterwards has to be taken into account.
+glm::mat4x4 Renderer::CalculateBandTransform(float mirrorY) const
+{
+	if (!settings_.IsBanded())
+	{
+		return glm::mat4x4(1.0f);
+	}
+
+	const float bandHeight = static_cast<float>(glContext_->GetSurfaceHeight());
+	const float scaleY = settings_.renderHeight / bandHeight;
+	const float offsetY = (settings_.renderHeight - 2.0f * bandOrigin_) / bandHeight - 1.0f;
+
+	return translate(glm::vec3(0.0f, offsetY * mirrorY, 0.0f)) * scale(glm::vec3(1.0f, scaleY, 1.0f));
+}
+
+// Clip space to whole image pixels, same as VShader mirror & viewport do.
+glm::mat4x4 Renderer::CalculateImageTransform(const glm::mat4x4& wvpMatrix) const
+{
+	const glm::vec3 halfSize(0.5f * settings_.renderWidth, 0.5f * settings_.renderHeight, 1.0f);
+
+	return translate(glm::vec3(halfSize.x, halfSize.y, 0.0f)) * scale(halfSize) *
+		scale(glm::vec3(GetMirrorXFactor(), GetMirrorYFactor(), 1.0f)) * wvpMatrix;
+}
+
 void Renderer::RenderCommon()
 {
 	const auto model = CalculateModelTransform();
@@ -272,63 +560,280 @@ void Renderer::RenderCommon()
 	const auto wvMatrix = view * model;
 	const auto wvpMatrix = proj * view * model;
 
+	if (settings_.cpuRendering)
+	{
+		RenderCpu(wvpMatrix);
+		return;
+	}
+
+	UpdateScissor();
+
+	// VShader mirrors transformed positions, MaskVShader does not
+	const auto modelWvpMatrix = CalculateBandTransform(GetMirrorYFactor()) * wvpMatrix;
+	const auto maskWvpMatrix = CalculateBandTransform(1.0f) * wvpMatrix;
+
 	GL_CHECK();
 
-	Model(wvpMatrix, settings_.doInflate ? settings_.inflateDistance : 0.0f);
-	Mask(wvpMatrix, wvMatrix, whiteTexture_);
+	Model(modelWvpMatrix, settings_.doInflate ? settings_.inflateDistance : 0.0f);
+	Mask(maskWvpMatrix, wvMatrix, whiteTexture_);
 
-	if (settings_.doSmallSpotsProcessing)
+	// mask is calculated once per slice: ERM image takes it from normal one instead of another readback
+	if (settings_.doSmallSpotsProcessing && !smallSpotsMaskValid_)
 	{
 		glContext_->Resolve(imageFBO_);
-		auto raster = glContext_->GetRaster();
-		std::vector<uint32_t> segmentedRaster(raster.size());
-		std::vector<Segment> segments;
-		
-		Segmentize(raster, segmentedRaster, segments, settings_.renderWidth, settings_.renderHeight, 255);
 
 		const auto physWidth = settings_.plateWidth / settings_.renderWidth;
 		const auto physHeight = settings_.plateHeight / settings_.renderHeight;
 		const auto physPixelArea = physWidth * physHeight;
 
-		for (const auto& segment : segments)
+		// each step dilates mask by one pixel
+		int dilateSteps = 0;
+		for (float expansionSize = 0.0f; expansionSize <= settings_.smallSpotInflateDistance; expansionSize += (physWidth + physHeight) / 2)
 		{
-			const uint8_t fillValue =
-				CalculateSegmentArea(segment, physPixelArea, raster,
-					segmentedRaster, settings_.renderWidth, settings_.renderHeight) > settings_.smallSpotThreshold ? 0 : 255;
-			
-			ForEachPixel(ExpandRange(segment.xBegin, segment.xEnd, 0, settings_.renderWidth),
-				ExpandRange(segment.yBegin, segment.yEnd, 0, settings_.renderHeight), [&](auto x, auto y) {
-					const size_t pixelIndex = y*settings_.renderWidth + x;
-					if (raster[pixelIndex] > 0 &&
-						AnyOfPixels(ExpandRange(x, x + 1, 0, settings_.renderWidth), ExpandRange(y, y + 1, 0, settings_.renderHeight),
-							[&](auto x, auto y) { return segmentedRaster[y*settings_.renderWidth + x] == segment.val; }))
-					{
-						raster[pixelIndex] = fillValue;
-					}
-			});
+			++dilateSteps;
 		}
-		
-		std::vector<uint8_t> rasterDilated(raster.size());
-		float expansionSize = 0.0f;
-		while (expansionSize <= settings_.smallSpotInflateDistance)
+
+		// labelling that doesn't converge in bounded number of passes falls back to CPU
+		smallSpotsMaskOnGpu_ = gpuSmallSpots_ &&
+			RenderSmallSpotsMask(physPixelArea / settings_.smallSpotThreshold, static_cast<uint32_t>(dilateSteps * 2 + 1));
+		glContext_->ResetFBO();
+		if (!smallSpotsMaskOnGpu_)
 		{
-			Dilate(raster, rasterDilated, settings_.renderWidth, settings_.renderHeight);
-			std::swap(raster, rasterDilated);
-			expansionSize += (physWidth + physHeight) / 2;
+			auto raster = glContext_->GetRaster();
+			const auto litRect = FindLitRect(raster, settings_.renderWidth, settings_.renderHeight, GetReadbackRect());
+			const auto isSmallSpot = [&](const Segment& segment) {
+				return segment.coverage * physPixelArea <= settings_.smallSpotThreshold;
+			};
+
+			if (settings_.samples == 0)
+			{
+				// without antialiasing mask is binary & has no fringe: islands are labelled by runs
+				// & dilated 64 pixels per word
+				const RunRaster runs(raster, settings_.renderWidth, settings_.renderHeight, litRect);
+				std::vector<uint32_t> runLabels;
+				std::vector<Segment> segments;
+				SegmentizeRuns(runs, runLabels, segments);
+
+				RunRaster smallSpots(settings_.renderWidth, settings_.renderHeight);
+				for (auto y = 0; y < runs.GetHeight(); ++y)
+				{
+					for (auto run = runs.GetRowBegin(y); run != runs.GetRowEnd(y); ++run)
+					{
+						if (isSmallSpot(segments[runLabels[runs.GetRunIndex(run)] - 1]))
+						{
+							smallSpots.AddRun(y, run->begin, run->length, run->value);
+						}
+					}
+				}
+				DilateSquare(smallSpots.ToBits(), dilateSteps).ToBytes(raster);
+			}
+			else
+			{
+				std::vector<uint32_t> segmentedRaster(raster.size());
+				std::vector<Segment> segments;
+
+				Segmentize(raster, segmentedRaster, segments, settings_.renderWidth, settings_.renderHeight, litRect, 255);
+
+				// islands not larger than threshold are filled with their fringe, larger ones are cleared
+				std::vector<uint8_t> fills(segments.size());
+				std::transform(segments.begin(), segments.end(), fills.begin(), [&](const Segment& segment) {
+					return static_cast<uint8_t>(isSmallSpot(segment) ? 255 : 0);
+				});
+				FillSegments(raster, segmentedRaster, fills, settings_.renderWidth, settings_.renderHeight, litRect);
+
+				std::vector<uint8_t> rasterDilated;
+				DilateSquare(raster, rasterDilated, settings_.renderWidth, settings_.renderHeight, dilateSteps, litRect);
+				std::swap(raster, rasterDilated);
+			}
+
+			glBindTexture(GL_TEXTURE_2D, maskTexture_.GetHandle());
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, settings_.renderWidth, settings_.renderHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, raster.data());
+			glBindTexture(GL_TEXTURE_2D, 0);
 		}
 
-		glBindTexture(GL_TEXTURE_2D, maskTexture_.GetHandle());
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, settings_.renderWidth, settings_.renderHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, raster.data());
-		glBindTexture(GL_TEXTURE_2D, 0);
+		smallSpotsMaskValid_ = true;
+		smallSpotsMaskOffset_ = modelOffset_;
+	}
+
+	if (settings_.doSmallSpotsProcessing)
+	{
+		// mask texture coordinates follow the model, so it is sampled where model was in image mask is made of
+		const auto maskWvMatrix = view * CalculateModelTransform(smallSpotsMaskOffset_);
 
-		Model(wvpMatrix, (settings_.doInflate ? settings_.inflateDistance : 0.0f) + settings_.smallSpotInflateDistance);
-		Mask(wvpMatrix, wvMatrix, maskTexture_);
+		Model(modelWvpMatrix, (settings_.doInflate ? settings_.inflateDistance : 0.0f) + settings_.smallSpotInflateDistance);
+		Mask(maskWvpMatrix, maskWvMatrix, smallSpotsMaskOnGpu_ ? smallSpotsMaskTexture_ : maskTexture_);
 		glContext_->Resolve(temporaryFBO_);
 
 		RenderCombineMax(temporaryTexture_);
 	}
 }
 
+// GPU passes & readback are limited to model footprint with room for inflate, small spots & support dilation,
+// image outside of it stays black. Footprint covers both normal & ERM images, so it changes only when mirroring does.
+void Renderer::UpdateScissor()
+{
+	if (!settings_.offscreen || settings_.IsBanded())
+	{
+		return;
+	}
+
+	const auto viewProjection = CalculateProjectionTransform() * CalculateViewTransform();
+	const auto normalOffset = modelOffset_ + ermShift_;
+	glm::vec2 footprintMin(std::numeric_limits<float>::max());
+	glm::vec2 footprintMax(std::numeric_limits<float>::lowest());
+	for (auto offset = 0; offset < (settings_.enableERM ? 2 : 1); ++offset)
+	{
+		const auto imageMatrix = CalculateImageTransform(viewProjection * CalculateModelTransform(offset ? normalOffset - ErmShift : normalOffset));
+		for (auto i = 0; i < 8; ++i)
+		{
+			const glm::vec3 corner(
+				(i & 1) ? model_.max.x : model_.min.x,
+				(i & 2) ? model_.max.y : model_.min.y,
+				(i & 4) ? model_.max.z : model_.min.z);
+			const auto position = imageMatrix * glm::vec4(corner, 1.0f);
+			footprintMin = glm::min(footprintMin, glm::vec2(position) / position.w);
+			footprintMax = glm::max(footprintMax, glm::vec2(position) / position.w);
+		}
+	}
+
+	const auto pixelsPerMm = std::max(settings_.renderWidth / settings_.plateWidth, settings_.renderHeight / settings_.plateHeight);
+	const auto marginDistance =
+		(settings_.doInflate ? settings_.inflateDistance : 0.0f) +
+		(settings_.doSmallSpotsProcessing ? settings_.smallSpotInflateDistance : 0.0f) +
+		(IsGpuOverhangs() ? settings_.maxSupportedDistance : 0.0f);
+	// antialiasing & rounding of small spots dilation & support kernel
+	const auto margin = marginDistance * pixelsPerMm + 3.0f;
+
+	const auto width = static_cast<int>(glContext_->GetSurfaceWidth());
+	const auto height = static_cast<int>(glContext_->GetSurfaceHeight());
+	const auto left = std::min(width, std::max(0, static_cast<int>(std::floor(footprintMin.x - margin))));
+	const auto bottom = std::min(height, std::max(0, static_cast<int>(std::floor(footprintMin.y - margin))));
+	const glm::ivec4 rect(left, bottom,
+		std::max(left, std::min(width, static_cast<int>(std::ceil(footprintMax.x + margin)))),
+		std::max(bottom, std::min(height, static_cast<int>(std::ceil(footprintMax.y + margin)))));
+
+	if (rect == scissorRect_)
+	{
+		return;
+	}
+
+	// packed images would be cleared together with render target
+	FlushReadbacks();
+	scissorRect_ = rect;
+
+	// pixels outside of new rect are not touched anymore, so they are cleared once
+	// (previous layer image outside of rect is never read)
+	glDisable(GL_SCISSOR_TEST);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	SetBlackClearColor();
+	for (const auto fbo : { imageFBO_.GetHandle(), temporaryFBO_.GetHandle() })
+	{
+		if (fbo)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+			glClear(GL_COLOR_BUFFER_BIT);
+		}
+	}
+	// pixel coordinates are read around processed pixels, so outside ones should hold no coordinates
+	glClearColor(1.0, 1.0, 1.0, 1.0);
+	for (const auto& fbo : seedFBOs_)
+	{
+		if (fbo.IsValid())
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, fbo.GetHandle());
+			glClear(GL_COLOR_BUFFER_BIT);
+		}
+	}
+	SetBlackClearColor();
+	glContext_->ResetFBO();
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(rect.x, rect.y, rect.z - rect.x, rect.w - rect.y);
+	glContext_->SetReadbackRect(rect.x, rect.y, rect.z - rect.x, rect.w - rect.y);
+	GL_CHECK();
+}
+
+void Renderer::RenderCpu(const glm::mat4x4& wvpMatrix)
+{
+	// shifted to current band
+	const auto imageMatrix = translate(glm::vec3(0.0f, -static_cast<float>(bandOrigin_), 0.0f)) * CalculateImageTransform(wvpMatrix);
+	const auto toScreen = [&](const glm::vec2& p) {
+		const auto position = imageMatrix * glm::vec4(p, model_.pos, 1.0f);
+		return glm::vec2(position) / position.w;
+	};
+
+	for (const auto& edge : sliceEdges_)
+	{
+		rasterizer_->AddEdge(toScreen(edge.from), toScreen(edge.to));
+	}
+	for (const auto& edge : offsetEdges_)
+	{
+		rasterizer_->AddEdge(toScreen(edge.from), toScreen(edge.to));
+	}
+	rasterizer_->Resolve(raster_, settings_.samples > 0);
+
+	// fullscreen output still works with GL image
+	if (!settings_.offscreen)
+	{
+		glContext_->SetRaster(raster_, glContext_->GetSurfaceWidth(), glContext_->GetSurfaceHeight());
+	}
+}
+
+// Inflate & small spots growth as true 2D offset of slice contours in model space,
+// so both are rasterized in the same single pass with the slice itself.
+void Renderer::CalculateOffsetEdges()
+{
+	offsetEdges_.clear();
+
+	const auto inflateDistance = settings_.doInflate ? settings_.inflateDistance : 0.0f;
+	if (inflateDistance <= 0.0f && !settings_.doSmallSpotsProcessing)
+	{
+		return;
+	}
+
+	ChainContours(sliceEdges_, contours_);
+	const auto islandAreas = settings_.doSmallSpotsProcessing ? CalculateIslandAreas(contours_) : std::vector<float>();
+
+	const auto pixelSize = std::min(settings_.plateWidth / settings_.renderWidth, settings_.plateHeight / settings_.renderHeight);
+	const auto arcTolerance = 0.25f * pixelSize;
+
+	for (size_t i = 0; i < contours_.size(); ++i)
+	{
+		auto distance = inflateDistance;
+		if (settings_.doSmallSpotsProcessing && islandAreas[i] <= settings_.smallSpotThreshold)
+		{
+			distance += settings_.smallSpotInflateDistance;
+		}
+		OffsetContour(contours_[i], distance, arcTolerance, offsetEdges_);
+	}
+}
+
+void Renderer::SliceContours()
+{
+	ChainContours(sliceEdges_, contours_);
+
+	const auto imageMatrix = CalculateImageTransform(
+		CalculateProjectionTransform() * CalculateViewTransform() * CalculateModelTransform());
+
+	// mirrored image would flip contours orientation
+	const bool reverse = imageMatrix[0][0] * imageMatrix[1][1] - imageMatrix[1][0] * imageMatrix[0][1] < 0.0f;
+
+	for (auto& contour : contours_)
+	{
+		for (auto& point : contour.points)
+		{
+			const auto position = imageMatrix * glm::vec4(point, model_.pos, 1.0f);
+			point = glm::vec2(position) / position.w;
+		}
+
+		if (reverse)
+		{
+			std::reverse(contour.points.begin(), contour.points.end());
+		}
+	}
+}
+
 void Renderer::RenderOffscreen()
 {
 	RenderCommon();
@@ -340,6 +845,16 @@ void Renderer::RenderFullscreen()
 	glContext_->SwapBuffers();
 }
 
+bool Renderer::IsVectorOutput() const
+{
+	return settings_.outputFormat != "png";
+}
+
+bool Renderer::IsGpuOverhangs() const
+{
+	return settings_.doOverhangAnalysis && settings_.gpuOverhangs;
+}
+
 bool Renderer::IsUpsideDownRendering() const
 {
 	return model_.pos <= (model_.max.z + model_.min.z) / 2;
@@ -354,10 +869,11 @@ bool Renderer::ShouldRender(const MeshInfo& info, float inflateDistance)
 
 void Renderer::Model(const glm::mat4x4& wvpMatrix, float inflateDistance)
 {
-	glViewport(0, 0, settings_.renderWidth, settings_.renderHeight);
+	glViewport(0, 0, glContext_->GetSurfaceWidth(), glContext_->GetSurfaceHeight());
 
-	glClearColor(0.0, 0.0, 0.0, 1.0);
+	SetBlackClearColor();
 	glClearStencil(0x80);
+	SetColorMask();
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
 
@@ -372,22 +888,71 @@ void Renderer::Model(const glm::mat4x4& wvpMatrix, float inflateDistance)
 	glStencilOpSeparate(GL_BACK, GL_KEEP, GL_KEEP, GL_INCR);
 	glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_KEEP, GL_DECR);
 	glStencilFunc(GL_ALWAYS, 0, 0xFF);
-	for (auto i = 0u; i < vBuffers_.size(); ++i)
+	glEnableVertexAttribArray(mainVertexPosAttrib_);
+	glEnableVertexAttribArray(mainVertexNormalAttrib_);
+
+	const auto indexType = uintIndices_ ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+	const size_t indexSize = uintIndices_ ? sizeof(uint32_t) : sizeof(uint16_t);
+
+	// visible chunks adjacent in index buffer are drawn by single call
+	size_t rangeOffset = 0;
+	GLsizei rangeCount = 0;
+	const auto drawRange = [&]() {
+		if (rangeCount > 0)
+		{
+			glDrawElements(GL_TRIANGLES, rangeCount, indexType, reinterpret_cast<const void*>(rangeOffset));
+			rangeCount = 0;
+		}
+	};
+
+	const auto NoBatch = std::numeric_limits<size_t>::max();
+	auto boundBatch = NoBatch;
+	for (const auto& info : meshInfo_)
 	{
-		if (ShouldRender(meshInfo_[i], inflateDistance))
+		if (!ShouldRender(info, inflateDistance))
 		{
-			glBindBuffer(GL_ARRAY_BUFFER, vBuffers_[i].GetHandle());
-			glVertexAttribPointer(mainVertexPosAttrib_, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-			glEnableVertexAttribArray(mainVertexPosAttrib_);
+			continue;
+		}
+
+		if (info.batch != boundBatch)
+		{
+			drawRange();
+			boundBatch = info.batch;
+			const auto& batch = batches_[boundBatch];
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.indices.GetHandle());
+			if (uintIndices_)
+			{
+				glBindBuffer(GL_ARRAY_BUFFER, batch.vertices.GetHandle());
+				glVertexAttribPointer(mainVertexPosAttrib_, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+				glBindBuffer(GL_ARRAY_BUFFER, batch.normals.GetHandle());
+				glVertexAttribPointer(mainVertexNormalAttrib_, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+			}
+		}
 
-			glBindBuffer(GL_ARRAY_BUFFER, nBuffers_[i].GetHandle());
-			glVertexAttribPointer(mainVertexNormalAttrib_, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-			glEnableVertexAttribArray(mainVertexNormalAttrib_);
+		// without base vertex draws 16-bit indices are rebased by attribute offsets
+		if (!uintIndices_)
+		{
+			const auto& batch = batches_[boundBatch];
+			glBindBuffer(GL_ARRAY_BUFFER, batch.vertices.GetHandle());
+			glVertexAttribPointer(mainVertexPosAttrib_, 3, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<const void*>(info.vertexOffset));
+			glBindBuffer(GL_ARRAY_BUFFER, batch.normals.GetHandle());
+			glVertexAttribPointer(mainVertexNormalAttrib_, 3, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<const void*>(info.vertexOffset));
+			glDrawElements(GL_TRIANGLES, info.idxCount, indexType, reinterpret_cast<const void*>(info.indexOffset));
+			continue;
+		}
 
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, iBuffers_[i].GetHandle());
-			glDrawElements(GL_TRIANGLES, meshInfo_[i].idxCount, GL_UNSIGNED_SHORT, 0);
+		if (rangeCount > 0 && rangeOffset + rangeCount * indexSize == info.indexOffset)
+		{
+			rangeCount += info.idxCount;
+		}
+		else
+		{
+			drawRange();
+			rangeOffset = info.indexOffset;
+			rangeCount = info.idxCount;
 		}
-	}	
+	}
+	drawRange();
 
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -418,7 +983,7 @@ void Renderer::Mask(const glm::mat4x4& wvpMatrix, const glm::mat4x4& wvMatrix, c
 	glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
 
 	glStencilFunc(ShouldMirrorX() ^ ShouldMirrorY() ? GL_GREATER : GL_LESS, 0x80, 0xFF);
-	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	SetColorMask();
 
 	glUniformMatrix4fv(maskWVTransformUniform_, 1, GL_FALSE, glm::value_ptr(wvMatrix));
 	glUniformMatrix4fv(maskWVPTransformUniform_, 1, GL_FALSE, glm::value_ptr(wvpMatrix));
@@ -435,6 +1000,26 @@ void Renderer::Mask(const glm::mat4x4& wvpMatrix, const glm::mat4x4& wvMatrix, c
 	GL_CHECK();
 }
 
+// Packed slices: image is written into its own channel (next one after already packed images),
+// so clear & mask keep the others.
+void Renderer::SetColorMask()
+{
+	if (settings_.packedSlices <= 1)
+	{
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		return;
+	}
+
+	const auto channel = packedImages_.size();
+	glColorMask(channel == 0, channel == 1, channel == 2, channel == 3);
+}
+
+// Alpha channel of packed render target holds the 4th image, so black is transparent there.
+void Renderer::SetBlackClearColor()
+{
+	glClearColor(0.0, 0.0, 0.0, settings_.packedSlices > 1 ? 0.0 : 1.0);
+}
+
 uint32_t Renderer::GetCurrentSlice() const
 {
 	return static_cast<uint32_t>(std::max((model_.pos - model_.min.z) / settings_.step + 0.5f - 1, 0.0f));
@@ -460,136 +1045,544 @@ bool Renderer::ShouldMirrorY() const
 	return settings_.mirrorY;
 }
 
-void Renderer::RenderOmniDilate(float scale, uint32_t kernelSize)
+// Pixel coordinates need 32 bits per pixel, so these targets are RGBA regardless of context image format.
+void Renderer::CreateSeedTargets()
 {
-	UniformSetters omniUniforms
+	seedFilter_ = Filter2D(SeedFShader);
+	jumpFloodStepFilter_ = Filter2D(JumpFloodStepFShader);
+	jumpFloodDilateFilter_ = Filter2D(JumpFloodDilateFShader);
+
+	for (size_t i = 0; i < seedFBOs_.size(); ++i)
 	{
-		[scale, kernelSize](const GLProgram& program)
-		{
-			const auto scaleUniform = glGetUniformLocation(program.GetHandle(), "scale");
-			ASSERT(scaleUniform != -1);
-			glUniform1f(scaleUniform, scale);
+		seedTextures_[i] = GLTexture::Create();
+		glBindTexture(GL_TEXTURE_2D, seedTextures_[i].GetHandle());
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, glContext_->GetSurfaceWidth(), glContext_->GetSurfaceHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		seedFBOs_[i] = GLFramebuffer::Create();
+		glBindFramebuffer(GL_FRAMEBUFFER, seedFBOs_[i].GetHandle());
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, seedTextures_[i].GetHandle(), 0);
+		CHECK(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+	}
+	GL_CHECK();
 
-			const auto kernelSizeUniform = glGetUniformLocation(program.GetHandle(), "kernelSize");
-			ASSERT(kernelSizeUniform != -1);
-			glUniform1f(kernelSizeUniform, static_cast<float>(kernelSize));
-		}
-	};
-	Render2DFilter(omniDilateProgram_, omniUniforms);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glContext_->ResetFBO();
 }
 
-void Renderer::RenderDifference()
+// Island areas are summed by blending points into half float texture & labelling convergence is checked by occlusion query
+// (bounded number of passes is run where query wrappers are not available), island area pass fetches label & coverage in vertex shader.
+// Pixels of island are spread over 4 channels, but thin island fills only 2 of them & any channel may get most of its pixels.
+// Half float sum of a channel stops growing when it's about 2048 pixel weights, so with threshold area of at most 2048 pixels
+// it stops only above threshold whatever channels island fills.
+bool Renderer::IsGpuSmallSpotsSupported() const
 {
-	UniformSetters differenceUniforms
+	const auto MaxThresholdPixels = 2048.0f;
+	const auto pixelArea = (settings_.plateWidth / settings_.renderWidth) * (settings_.plateHeight / settings_.renderHeight);
+	if (settings_.smallSpotThreshold / pixelArea > MaxThresholdPixels)
 	{
-		[this](const GLProgram& program)
-		{
-			const auto previousLayerTextureUniform = glGetUniformLocation(program.GetHandle(), "previousLayerTexture");
-			ASSERT(previousLayerTextureUniform != -1);
-			glUniform1i(previousLayerTextureUniform, 1);
-
-			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_2D, this->previousLayerImageTexture_.GetHandle());
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		}
-	};
-	Render2DFilter(differenceProgram_, differenceUniforms);
+		return false;
+	}
+
+	GLint vertexTextureUnits = 0;
+	glGetIntegerv(GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS, &vertexTextureUnits);
+
+	return vertexTextureUnits >= 2 &&
+#ifdef ANGLE
+		IsGLExtensionSupported("GL_EXT_occlusion_query_boolean") &&
+#endif
+		IsGLExtensionSupported("GL_OES_texture_half_float") &&
+		IsGLExtensionSupported("GL_EXT_color_buffer_half_float");
 }
 
-void Renderer::RenderCombineMax(const GLTexture& combineTexture)
+void Renderer::CreateSmallSpotsTargets()
 {
-	UniformSetters combineMaxUniforms
+	labelPropagateFilter_ = Filter2D(LabelPropagateFShader);
+#ifdef ANGLE
+	labelChangedFilter_ = Filter2D(LabelChangedFShader);
+#endif
+	labelFringeFilter_ = Filter2D(LabelFringeFShader);
+	smallSpotsMaskFilter_ = Filter2D(SmallSpotsMaskFShader);
+
+	islandAreaProgram_ = CreateProgram(CreateVertexShader(IslandAreaVShader), CreateFragmentShader(IslandAreaFShader));
+	islandAreaTexelSizeUniform_ = glGetUniformLocation(islandAreaProgram_.GetHandle(), "texelSize");
+	ASSERT(islandAreaTexelSizeUniform_ != -1);
+	islandAreaLabelTextureUniform_ = glGetUniformLocation(islandAreaProgram_.GetHandle(), "labelTexture");
+	ASSERT(islandAreaLabelTextureUniform_ != -1);
+	islandAreaCoverageTextureUniform_ = glGetUniformLocation(islandAreaProgram_.GetHandle(), "coverageTexture");
+	ASSERT(islandAreaCoverageTextureUniform_ != -1);
+	islandAreaPixelWeightUniform_ = glGetUniformLocation(islandAreaProgram_.GetHandle(), "pixelWeight");
+	ASSERT(islandAreaPixelWeightUniform_ != -1);
+	islandAreaPixelAttrib_ = glGetAttribLocation(islandAreaProgram_.GetHandle(), "vPixel");
+	ASSERT(islandAreaPixelAttrib_ != -1);
+	GL_CHECK();
+
+	const auto width = glContext_->GetSurfaceWidth();
+	const auto height = glContext_->GetSurfaceHeight();
+
+	islandAreaTexture_ = GLTexture::Create();
+	glBindTexture(GL_TEXTURE_2D, islandAreaTexture_.GetHandle());
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_HALF_FLOAT_OES, nullptr);
+	islandAreaFBO_ = GLFramebuffer::Create();
+	glBindFramebuffer(GL_FRAMEBUFFER, islandAreaFBO_.GetHandle());
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, islandAreaTexture_.GetHandle(), 0);
+	CHECK(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+	GL_CHECK();
+
+	glContext_->CreateTextureFBO(smallSpotsMaskFBO_, smallSpotsMaskTexture_);
+
+	// rows are consecutive, so pixels of processed rows are drawn by single call
+	std::vector<uint16_t> pixels;
+	pixels.reserve(static_cast<size_t>(width) * height * 2);
+	for (uint32_t y = 0; y < height; ++y)
 	{
-		[this, &combineTexture](const GLProgram& program)
+		for (uint32_t x = 0; x < width; ++x)
 		{
-			const auto combineTextureUniform = glGetUniformLocation(program.GetHandle(), "combineTexture");
-			ASSERT(combineTextureUniform != -1);
-			glUniform1i(combineTextureUniform, 1);
-
-			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_2D, combineTexture.GetHandle());
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			pixels.push_back(static_cast<uint16_t>(x));
+			pixels.push_back(static_cast<uint16_t>(y));
 		}
-	};
-	Render2DFilter(combineMaxProgram_, combineMaxUniforms);
+	}
+	pixelsBuffer_ = GLBuffer::Create();
+	glBindBuffer(GL_ARRAY_BUFFER, pixelsBuffer_.GetHandle());
+	glBufferData(GL_ARRAY_BUFFER, pixels.size() * sizeof(uint16_t), pixels.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+#ifdef ANGLE
+	labelsChangedQuery_ = GLQuery::Create();
+	GL_CHECK();
+#endif
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glContext_->ResetFBO();
 }
 
-void Renderer::Render2DFilter(const GLProgram& program, const UniformSetters& additionalUniformSetters)
+// Small spots mask of resolved image without readback: islands of fully covered pixels are labelled,
+// their area (with fringe) is summed at label pixel & mask is dilated by square kernel.
+// Returns false when labelling hasn't converged.
+bool Renderer::RenderSmallSpotsMask(float pixelWeight, uint32_t kernelSize)
 {
-	glViewport(0, 0, settings_.renderWidth, settings_.renderHeight);
+	size_t current = 0;
+	if (!LabelIslands(current))
+	{
+		return false;
+	}
 
-	glDisable(GL_STENCIL_TEST);
-	glCullFace(GL_FRONT);
+	glBindFramebuffer(GL_FRAMEBUFFER, seedFBOs_[1 - current].GetHandle());
+	labelFringeFilter_.SetTexture("coverageTexture", 1, imageTexture_);
+	Render2DFilter(labelFringeFilter_, seedTextures_[current]);
+	current = 1 - current;
 
-	glClearColor(0.0, 0.0, 0.0, 1.0);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+	RenderIslandAreas(seedTextures_[current], pixelWeight);
 
-	glUseProgram(program.GetHandle());
-	const auto textureUniform = glGetUniformLocation(program.GetHandle(), "texture");
-	ASSERT(textureUniform != -1);
-	const auto texelSizeUniform = glGetUniformLocation(program.GetHandle(), "texelSize");
-	const auto vertexPosAttrib = glGetAttribLocation(program.GetHandle(), "vPosition");
-	ASSERT(vertexPosAttrib != -1);
-	GL_CHECK();
+	glBindFramebuffer(GL_FRAMEBUFFER, smallSpotsMaskFBO_.GetHandle());
+	smallSpotsMaskFilter_.SetTexture("coverageTexture", 1, imageTexture_);
+	smallSpotsMaskFilter_.SetTexture("areaTexture", 2, islandAreaTexture_);
+	Render2DFilter(smallSpotsMaskFilter_, seedTextures_[current]);
 
-	for (const auto& s : additionalUniformSetters)
+	glBindFramebuffer(GL_FRAMEBUFFER, temporaryFBO_.GetHandle());
+	RenderMaxFilter(smallSpotsMaskTexture_, glm::vec2(1.0f, 0.0f), kernelSize, 0.0f, 1.0f);
+	glBindFramebuffer(GL_FRAMEBUFFER, smallSpotsMaskFBO_.GetHandle());
+	RenderMaxFilter(temporaryTexture_, glm::vec2(0.0f, 1.0f), kernelSize, 0.0f, 1.0f);
+	return true;
+}
+
+// Label propagation moves labels by one pixel per pass & pointer jumping shortcuts already labelled paths,
+// so passes are bounded by twice the log2 of processed rect size (with margin). Convergence is checked every few passes
+// as waiting for query result stalls pipeline. current: index of seed texture with labels.
+// Returns false when labels still change after the last pass.
+bool Renderer::LabelIslands(size_t& current)
+{
+	const auto LabelsCheckInterval = 4;
+	const auto PassesMargin = 8;
+	const float FullCoverage = 1.0f - 0.5f / 255.0f;
+
+	const auto rect = GetProcessedRect();
+	const auto extent = std::max(std::max(rect.z - rect.x, rect.w - rect.y), 2);
+	auto maxPasses = 2 * static_cast<int>(std::ceil(std::log2(static_cast<float>(extent)))) + PassesMargin;
+	// the last pass is checked
+	maxPasses += (LabelsCheckInterval - maxPasses % LabelsCheckInterval) % LabelsCheckInterval;
+
+	current = 0;
+	glBindFramebuffer(GL_FRAMEBUFFER, seedFBOs_[current].GetHandle());
+	seedFilter_.SetUniform("threshold", FullCoverage);
+	Render2DFilter(seedFilter_, imageTexture_);
+
+	// labels only decrease, so passes end when none of them changes
+	for (auto pass = 1; pass <= maxPasses; ++pass)
 	{
-		s(program);
+		glBindFramebuffer(GL_FRAMEBUFFER, seedFBOs_[1 - current].GetHandle());
+		Render2DFilter(labelPropagateFilter_, seedTextures_[current]);
+		current = 1 - current;
+
+#ifdef ANGLE
+		if (pass % LabelsCheckInterval == 0 && !HaveLabelsChanged(current))
+		{
+			return true;
+		}
+#endif
 	}
+
+#ifdef ANGLE
+	BOOST_LOG_TRIVIAL(info) << "Small spots labelling hasn't converged in " << maxPasses << " passes, mask is made on CPU";
+	return false;
+#else
+	// without occlusion query all passes are run, so labels never cross the bus
+	return true;
+#endif
+}
+
+#ifdef ANGLE
+// Compares labels of last pass with previous ones (rendered into temporary target).
+bool Renderer::HaveLabelsChanged(size_t current)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, temporaryFBO_.GetHandle());
+	labelChangedFilter_.SetTexture("previousTexture", 1, seedTextures_[1 - current]);
+
+	glBeginQueryEXT(GL_ANY_SAMPLES_PASSED_EXT, labelsChangedQuery_.GetHandle());
+	Render2DFilter(labelChangedFilter_, seedTextures_[current]);
+	glEndQueryEXT(GL_ANY_SAMPLES_PASSED_EXT);
+
+	GLuint anyChanged = GL_FALSE;
+	glGetQueryObjectuivEXT(labelsChangedQuery_.GetHandle(), GL_QUERY_RESULT_EXT, &anyChanged);
 	GL_CHECK();
+	return anyChanged != GL_FALSE;
+}
+#endif
+
+void Renderer::RenderIslandAreas(const GLTexture& labelTexture, float pixelWeight)
+{
+	const auto width = glContext_->GetSurfaceWidth();
+	const auto height = glContext_->GetSurfaceHeight();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, islandAreaFBO_.GetHandle());
+	glViewport(0, 0, width, height);
+	glDisable(GL_STENCIL_TEST);
+	glClearColor(0.0, 0.0, 0.0, 0.0);
+	glClear(GL_COLOR_BUFFER_BIT);
+	SetBlackClearColor();
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+
+	glUseProgram(islandAreaProgram_.GetHandle());
+	glUniform2f(islandAreaTexelSizeUniform_, 1.0f / width, 1.0f / height);
+	glUniform1f(islandAreaPixelWeightUniform_, pixelWeight);
+	glUniform1i(islandAreaLabelTextureUniform_, 0);
+	glUniform1i(islandAreaCoverageTextureUniform_, 1);
 
 	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, labelTexture.GetHandle());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, imageTexture_.GetHandle());
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glActiveTexture(GL_TEXTURE0);
 
-	glUniform1i(textureUniform, 0);
-	glUniform2f(texelSizeUniform, 1.0f / settings_.renderWidth, 1.0f / settings_.renderHeight);
-
+	// only rows of processed rect may have labels
+	const auto rect = GetProcessedRect();
+	glBindBuffer(GL_ARRAY_BUFFER, pixelsBuffer_.GetHandle());
+	glVertexAttribPointer(islandAreaPixelAttrib_, 2, GL_UNSIGNED_SHORT, GL_FALSE, 0, nullptr);
+	glEnableVertexAttribArray(islandAreaPixelAttrib_);
+	glDrawArrays(GL_POINTS, rect.y * width, (rect.w - rect.y) * width);
+	glDisableVertexAttribArray(islandAreaPixelAttrib_);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	const float quad[] =
+
+	glDisable(GL_BLEND);
+	GL_CHECK();
+}
+
+// GPU passes are limited to scissor rect in offscreen mode, whole surface is processed otherwise.
+glm::ivec4 Renderer::GetProcessedRect() const
+{
+	if (settings_.offscreen && !settings_.IsBanded())
 	{
-		-1, -1,
-		-1, 1,
-		1, 1,
+		return scissorRect_;
+	}
+	return glm::ivec4(0, 0, glContext_->GetSurfaceWidth(), glContext_->GetSurfaceHeight());
+}
 
-		-1, -1,
-		1, 1,
-		1, -1
-	};
-	glVertexAttribPointer(vertexPosAttrib, 2, GL_FLOAT, GL_FALSE, 0, quad);
-	glEnableVertexAttribArray(vertexPosAttrib);
-	glDrawArrays(GL_TRIANGLES, 0, _countof(quad) / 2);
+// Read back image is black outside of processed rect (CPU rendered image is not limited by scissor).
+RasterRect Renderer::GetReadbackRect() const
+{
+	if (settings_.cpuRendering)
+	{
+		return GetFullRect(glContext_->GetSurfaceWidth(), glContext_->GetSurfaceHeight());
+	}
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	const auto rect = GetProcessedRect();
+	return RasterRect{ rect.x, rect.y, rect.z, rect.w };
+}
+
+// Square kernel max is separable: horizontal pass to temporary texture & vertical one to target,
+// 2k texture fetches per pixel instead of k^2.
+void Renderer::RenderSquareDilate(float scale, uint32_t kernelSize, const GLFramebuffer& target)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, temporaryFBO_.GetHandle());
+	RenderMaxFilter(imageTexture_, glm::vec2(1.0f, 0.0f), kernelSize, 0.0f, 1.0f);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, target.GetHandle());
+	RenderMaxFilter(temporaryTexture_, glm::vec2(0.0f, 1.0f), kernelSize, 1.0f, scale);
+}
+
+// Jump flooding finds nearest image pixel within radius in log2(radius) passes of 9 texture fetches.
+void Renderer::RenderCircleDilate(float scale, uint32_t radius, const GLFramebuffer& target)
+{
+	size_t current = 0;
+	glBindFramebuffer(GL_FRAMEBUFFER, seedFBOs_[current].GetHandle());
+	seedFilter_.SetUniform("threshold", 0.5f);
+	Render2DFilter(seedFilter_, imageTexture_);
+
+	// steps k, k/2, ..., 1 reach 2k - 1 pixels, extra unit step fixes most of jump flooding errors
+	uint32_t firstStep = 1;
+	while (firstStep * 2 - 1 < radius)
+	{
+		firstStep *= 2;
+	}
+
+	std::vector<uint32_t> steps;
+	for (auto step = firstStep; step > 0; step /= 2)
+	{
+		steps.push_back(step);
+	}
+	steps.push_back(1);
+
+	for (const auto step : steps)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, seedFBOs_[1 - current].GetHandle());
+		jumpFloodStepFilter_.SetUniform("stepSize", static_cast<float>(step));
+		Render2DFilter(jumpFloodStepFilter_, seedTextures_[current]);
+		current = 1 - current;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, target.GetHandle());
+	jumpFloodDilateFilter_.SetUniform("radius", static_cast<float>(radius));
+	jumpFloodDilateFilter_.SetUniform("scale", scale);
+	jumpFloodDilateFilter_.SetTexture("baseTexture", 1, imageTexture_);
+	Render2DFilter(jumpFloodDilateFilter_, seedTextures_[current]);
+}
+
+void Renderer::RenderMaxFilter(const GLTexture& texture, const glm::vec2& direction, uint32_t kernelSize, float baseScale, float scale)
+{
+	maxFilter_.SetUniform("direction", direction);
+	maxFilter_.SetUniform("kernelSize", static_cast<float>(kernelSize));
+	maxFilter_.SetUniform("baseScale", baseScale);
+	maxFilter_.SetUniform("scale", scale);
+	maxFilter_.SetTexture("baseTexture", 1, imageTexture_);
+	Render2DFilter(maxFilter_, texture);
+}
+
+void Renderer::RenderDifference()
+{
+	differenceFilter_.SetTexture("previousLayerTexture", 1, previousLayerImageTexture_);
+	Render2DFilter(differenceFilter_, imageTexture_);
+}
+
+void Renderer::RenderCombineMax(const GLTexture& combineTexture)
+{
+	combineMaxFilter_.SetTexture("combineTexture", 1, combineTexture);
+	Render2DFilter(combineMaxFilter_, imageTexture_);
+}
+
+void Renderer::Render2DFilter(Filter2D& filter, const GLTexture& texture)
+{
+	glViewport(0, 0, glContext_->GetSurfaceWidth(), glContext_->GetSurfaceHeight());
+
+	glDisable(GL_STENCIL_TEST);
+	glCullFace(GL_FRONT);
+
+	SetBlackClearColor();
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+	filter.Render(texture, glContext_->GetSurfaceWidth(), glContext_->GetSurfaceHeight());
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-	GL_CHECK();
 }
 
 void Renderer::SavePng(const std::string& fileName)
 {
-	if (raster_.empty())
+	const auto overhangsLayer = overhangsLayer_;
+	overhangsLayer_ = -1;
+	auto overhangs = std::move(overhangs_);
+
+	if (settings_.IsBanded())
 	{
-		raster_ = glContext_->GetRaster();
+		SavePngBanded(fileName);
+		return;
 	}
 
-	auto pixData = std::make_shared<const std::vector<uint8_t>>(std::move(raster_));
-	const auto concurrency = settings_.queue;
-	const bool clearCompletedTasks = pngSaveResult_.size() > concurrency;
+	if (const auto sliceImage = FindSliceImage())
+	{
+		// image being reused has to be encoded, so it should not wait in readback queue
+		FlushReadbacks();
+		if (overhangsLayer >= 0)
+		{
+			overhangAnalyzer_->RepeatLayer(static_cast<uint32_t>(overhangsLayer));
+		}
+
+		auto png = sliceImage->png;
+		QueuePngSave(std::async(std::launch::async, [png, fileName, this]() {
+			if (this->settings_.simulate)
+			{
+				return;
+			}
+			WriteFile(fileName, *png.get());
+		}));
+		return;
+	}
+
+	auto encoded = KeepSliceImage();
+	if (!raster_.empty())
+	{
+		SaveRaster(fileName, std::move(raster_), GetFullRect(settings_.renderWidth, settings_.renderHeight), encoded, overhangsLayer, nullptr);
+		raster_.clear();
+		return;
+	}
+
+	packedImages_.push_back(PendingReadback{ fileName, encoded, GetReadbackRect(), overhangsLayer, std::move(overhangs) });
+	if (packedImages_.size() >= settings_.packedSlices)
+	{
+		RequestReadback();
+	}
+}
+
+// Image is taken from GPU after the next one is rendered, so rendering & transfer overlap.
+void Renderer::RequestReadback()
+{
+	glContext_->RequestRaster(static_cast<uint32_t>(packedImages_.size()));
+	pendingReadbacks_.push_back(std::move(packedImages_));
+	packedImages_.clear();
+
+	const auto ReadbackLatency = 1u;
+	while (pendingReadbacks_.size() > ReadbackLatency)
+	{
+		ReceiveReadback();
+	}
+}
+
+void Renderer::ReceiveReadback()
+{
+	auto images = std::move(pendingReadbacks_.front());
+	pendingReadbacks_.pop_front();
+
+	auto raster = glContext_->ReceiveRaster();
+	if (images.size() == 1)
+	{
+		SaveRaster(images.front().fileName, std::move(raster), images.front().rect, images.front().encoded, images.front().overhangsLayer,
+			images.front().overhangs);
+		return;
+	}
+
+	// channels are one after another
+	const size_t imageSize = raster.size() / images.size();
+	for (size_t i = 0; i < images.size(); ++i)
+	{
+		const auto channelBegin = raster.begin() + imageSize * i;
+		SaveRaster(images[i].fileName, std::vector<uint8_t>(channelBegin, channelBegin + imageSize), images[i].rect, images[i].encoded,
+			images[i].overhangsLayer, images[i].overhangs);
+	}
+}
+
+void Renderer::FlushReadbacks()
+{
+	if (!packedImages_.empty())
+	{
+		RequestReadback();
+	}
+
+	while (!pendingReadbacks_.empty())
+	{
+		ReceiveReadback();
+	}
+}
+
+void Renderer::WaitForSaving()
+{
+	FlushReadbacks();
+
+	for (auto& v : pngSaveResult_)
+	{
+		v.get();
+	}
+	pngSaveResult_.clear();
+
+	if (bandWriteResult_.valid())
+	{
+		bandWriteResult_.get();
+	}
+}
+
+// Encoded image is kept while next slices are identical.
+Renderer::EncodedPngPromise Renderer::KeepSliceImage()
+{
+	if (!settings_.reuseSlices)
+	{
+		return nullptr;
+	}
+
+	auto encoded = std::make_shared<std::promise<EncodedPng>>();
+	sliceImages_.push_back(SliceImage{ renderedModelOffset_, encoded->get_future().share() });
+	return encoded;
+}
+
+// Only rows with lit pixels inside of rect are read by encoder, the others are written as black.
+void Renderer::SaveRaster(const std::string& fileName, std::vector<uint8_t> raster, const RasterRect& rect, const EncodedPngPromise& encoded,
+	int overhangsLayer, std::shared_ptr<const std::vector<uint8_t>> overhangs)
+{
+	auto pixData = std::make_shared<const std::vector<uint8_t>>(std::move(raster));
+	if (overhangsLayer >= 0 && overhangs)
+	{
+		overhangAnalyzer_->AddLayer(static_cast<uint32_t>(overhangsLayer), pixData, rect, std::move(overhangs));
+	}
+	else if (overhangsLayer >= 0)
+	{
+		overhangAnalyzer_->AddLayer(static_cast<uint32_t>(overhangsLayer), pixData, rect);
+	}
 
 	const auto targetWidth = settings_.renderWidth;
 	const auto targetHeight = settings_.renderHeight;
-	auto future = std::async(std::launch::async, [pixData, fileName, targetWidth, targetHeight, this]() {
+	QueuePngSave(std::async(std::launch::async, [pixData, fileName, targetWidth, targetHeight, rect, encoded, this]() {
 		if (this->settings_.simulate)
 		{
+			if (encoded)
+			{
+				encoded->set_value(std::make_shared<const std::vector<uint8_t>>());
+			}
 			return;
 		}
+
 		const auto BitsPerChannel = 8;
-		WritePng(fileName, targetWidth, targetHeight, BitsPerChannel, *pixData, this->palette_);
-	});
-	
+		const auto litRect = FindLitRect(*pixData, targetWidth, targetHeight, rect);
+		const auto litRowsBegin = static_cast<uint32_t>(litRect.yBegin);
+		const auto litRowsEnd = static_cast<uint32_t>(litRect.yEnd);
+		if (!encoded)
+		{
+			WritePng(fileName, targetWidth, targetHeight, BitsPerChannel, *pixData, this->palette_, litRowsBegin, litRowsEnd);
+			return;
+		}
+
+		EncodedPng png;
+		try
+		{
+			png = std::make_shared<const std::vector<uint8_t>>(
+				EncodePng(targetWidth, targetHeight, BitsPerChannel, *pixData, this->palette_, litRowsBegin, litRowsEnd));
+			encoded->set_value(png);
+		}
+		catch (...)
+		{
+			encoded->set_exception(std::current_exception());
+			throw;
+		}
+		WriteFile(fileName, *png);
+	}));
+}
+
+void Renderer::QueuePngSave(std::future<void> future)
+{
+	const auto concurrency = settings_.queue;
+	const bool clearCompletedTasks = pngSaveResult_.size() > concurrency;
+
 	if (clearCompletedTasks)
 	{
 		pngSaveResult_.erase(std::remove_if(pngSaveResult_.begin(), pngSaveResult_.end(), [](std::future<void>& v) {
@@ -606,41 +1599,141 @@ void Renderer::SavePng(const std::string& fileName)
 	pngSaveResult_.emplace_back(std::move(future));
 }
 
+// Peak memory is bounded by two bands: the one being rendered & the one being compressed.
+void Renderer::SavePngBanded(const std::string& fileName)
+{
+	const auto currentOffset = modelOffset_;
+	modelOffset_ = renderedModelOffset_;
+
+	BOOST_SCOPE_EXIT(&currentOffset, &modelOffset_, &bandOrigin_)
+	{
+		modelOffset_ = currentOffset;
+		bandOrigin_ = 0;
+	}
+	BOOST_SCOPE_EXIT_END
+
+	const auto height = settings_.renderHeight;
+	const auto bandHeight = glContext_->GetSurfaceHeight();
+
+	std::shared_ptr<PngWriter> writer;
+	if (!settings_.simulate)
+	{
+		const auto BitsPerChannel = 8;
+		const auto Channels = 1;
+		writer = std::make_shared<PngWriter>(fileName, settings_.renderWidth, height, BitsPerChannel, Channels, palette_);
+	}
+
+	for (bandOrigin_ = 0; bandOrigin_ < height; bandOrigin_ += bandHeight)
+	{
+		RenderCommon();
+
+		std::vector<uint8_t> raster;
+		if (settings_.cpuRendering)
+		{
+			std::swap(raster, raster_);
+		}
+		else
+		{
+			raster = glContext_->GetRaster();
+		}
+
+		auto bandData = std::make_shared<const std::vector<uint8_t>>(std::move(raster));
+		const auto rows = std::min(bandHeight, height - bandOrigin_);
+
+		// previous band is compressed while this one is rendered
+		if (bandWriteResult_.valid())
+		{
+			bandWriteResult_.get();
+		}
+
+		if (writer)
+		{
+			const auto width = static_cast<int>(settings_.renderWidth);
+			const auto surfaceHeight = static_cast<int>(bandHeight);
+			bandWriteResult_ = std::async(std::launch::async, [writer, bandData, rows, width, surfaceHeight]() {
+				const auto litRect = FindLitRect(*bandData, width, surfaceHeight, GetFullRect(width, static_cast<int>(rows)));
+				writer->WriteRows(bandData->data(), rows, static_cast<uint32_t>(litRect.yBegin), static_cast<uint32_t>(litRect.yEnd));
+			});
+		}
+	}
+}
+
 void Renderer::ERM()
 {
-	const glm::vec2 offset(0.5f, 0.5f);
-	modelOffset_ -= offset;
+	ermShift_ = ErmShift;
+	modelOffset_ -= ermShift_;
 
-	BOOST_SCOPE_EXIT(&offset, &modelOffset_)
+	BOOST_SCOPE_EXIT(&ermShift_, &modelOffset_)
 	{
-		modelOffset_ += offset;
+		modelOffset_ += ermShift_;
+		ermShift_ = glm::vec2(0.0f, 0.0f);
 	}
 	BOOST_SCOPE_EXIT_END
 
 	Render();
 }
 
-void Renderer::AnalyzeOverhangs(uint32_t imageNumber)
+// Image is analyzed when it's read back for saving, so GPU doesn't wait for another readback.
+// Reused slice is identical to previous layer, it's only counted by island tracking.
+void Renderer::AnalyzeOverhangs(uint32_t layer)
 {
+	// reports are created when output directory exists
+	if (!overhangAnalyzer_)
+	{
+		const auto supportRadius = std::ceil(settings_.maxSupportedDistance * settings_.renderWidth / settings_.plateWidth);
+		const auto pixelArea = (settings_.plateWidth / settings_.renderWidth) * (settings_.plateHeight / settings_.renderHeight);
+		const auto outputDir = boost::filesystem::path(settings_.outputDir);
+		const auto reportFileName = settings_.simulate ? std::string() : (outputDir / "overhangs.csv").string();
+		const auto islandsReportFileName = settings_.simulate ? std::string() : (outputDir / "islands.csv").string();
+		overhangAnalyzer_.reset(new OverhangAnalyzer(
+			static_cast<int>(settings_.renderWidth), static_cast<int>(settings_.renderHeight),
+			supportRadius, settings_.supportKernel == "circle", pixelArea, settings_.step, reportFileName, islandsReportFileName));
+	}
+
+	overhangsLayer_ = static_cast<int>(layer);
+
+	// reused image is not rendered, so previous layer support stays valid
+	if (!IsGpuOverhangs() || FindSliceImage())
+	{
+		return;
+	}
+
 	glContext_->Resolve(imageFBO_);
 	glBindFramebuffer(GL_FRAMEBUFFER, temporaryFBO_.GetHandle());
 	RenderDifference();
-	raster_ = glContext_->GetRaster();
-	if (HasOverhangs(raster_, glContext_->GetSurfaceWidth(), glContext_->GetSurfaceHeight()))
+	overhangs_ = std::make_shared<const std::vector<uint8_t>>(glContext_->GetRaster());
+
+	const auto supportedPixels = static_cast<uint32_t>(std::ceil(settings_.maxSupportedDistance * settings_.renderWidth / settings_.plateWidth));
+	if (settings_.supportKernel == "circle")
 	{
-		std::cout << "Has overhangs at image: " << imageNumber << "\n";
-		std::stringstream s;
-		s << std::setfill('0') << std::setw(5) << imageNumber << "_overhangs.png";
-		SavePng((boost::filesystem::path(settings_.outputDir) / s.str()).string());
+		RenderCircleDilate(1.0f, supportedPixels, previousLayerImageFBO_);
+	}
+	else
+	{
+		RenderSquareDilate(1.0f, supportedPixels * 2 + 1, previousLayerImageFBO_);
 	}
-	raster_.clear();
-
-	glBindFramebuffer(GL_FRAMEBUFFER, previousLayerImageFBO_.GetHandle());
-	const auto supportedPixels = static_cast<uint32_t>(ceil(settings_.maxSupportedDistance * settings_.renderWidth / settings_.plateWidth));
-	RenderOmniDilate(1.0f, supportedPixels * 2 + 1);
 	glContext_->ResetFBO();
 }
 
+void Renderer::FinishOverhangsAnalysis()
+{
+	FlushReadbacks();
+	if (overhangAnalyzer_)
+	{
+		overhangAnalyzer_->Finish();
+	}
+}
+
+const std::vector<Contour>& Renderer::GetContours() const
+{
+	return contours_;
+}
+
+float Renderer::GetLayerTop() const
+{
+	return model_.pos - model_.min.z + settings_.step / 2;
+}
+
 std::pair<glm::vec2, glm::vec2> Renderer::GetModelProjectionRect() const
 {
 	const auto model = CalculateModelTransform();
@@ -660,23 +1753,4 @@ std::pair<glm::vec2, glm::vec2> Renderer::GetModelProjectionRect() const
 	const auto screenMax = glm::vec2(homoMax / homoMax.w);
 
 	return std::make_pair(glm::min(screenMin, screenMax), glm::max(screenMin, screenMax));
-}
-
-namespace
-{
-
-	bool HasOverhangs(const std::vector<uint8_t>& raster, uint32_t width, uint32_t height)
-	{
-		const auto Threshold = 255;
-		for (auto v : raster)
-		{
-			if (v >= Threshold)
-			{
-				return true;
-			}
-		}
-		return false;
-	}
-
-	
-} //namespace
+}
\ No newline at end of file
@@ -1,6 +1,13 @@
 #pragma once
 
 #include "GlContext.h"
+#include "Filter2D.h"
+
+#include <MeshSlicer.h>
+#include <Rasterizer.h>
+#include <Raster.h>
+#include <OverhangAnalyzer.h>
+#include <Contours.h>
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
@@ -10,6 +17,7 @@
 #include <vector>
 #include <array>
 #include <future>
+#include <deque>
 
 #include <cstdint>
 
@@ -22,13 +30,18 @@ struct Settings
 	std::string modelFile;
 
 	std::string outputDir;
+	std::string outputFormat = "png";
 
 	float step = 0.025f;
 
 	uint32_t renderWidth = 1920;
 	uint32_t renderHeight = 1080;
+	uint32_t bandHeight = 0;
 
 	uint32_t samples = 0;
+	bool cpuRendering = false;
+	bool reuseSlices = false;
+	uint32_t packedSlices = 1;
 	uint32_t queue = std::max(1u, std::thread::hardware_concurrency());
 	uint32_t whiteLayers = 1;
 	float basementBorder = 5.0f;
@@ -41,6 +54,9 @@ struct Settings
 
 	bool doOverhangAnalysis = false;
 	float maxSupportedDistance = 0.5f;
+	std::string supportKernel = "square";
+	// overhangs are found by GPU difference against dilated previous layer instead of CPU runs
+	bool gpuOverhangs = false;
 
 	bool enableERM = false;
 	std::string envisiontechTemplatesPath = "envisiontech";
@@ -53,6 +69,9 @@ struct Settings
 	bool mirrorY = false;
 
 	bool simulate = false;
+
+	// slice is rendered & saved by horizontal bands
+	bool IsBanded() const { return bandHeight > 0 && bandHeight < renderHeight; }
 };
 
 class Renderer
@@ -67,9 +86,23 @@ public:
 	void FirstSlice();
 	bool NextSlice();
 	void White();
+	// waits for images being read back from GPU & queues them for saving
+	void FlushReadbacks();
+	// flushes readbacks & waits for saving of all images, saving errors are thrown here
+	void WaitForSaving();
 	void ERM();
-	void AnalyzeOverhangs(uint32_t imageNumber);
+	// image saved next is analyzed for parts unsupported by previous analyzed image,
+	// layer: slice number reported for it (white layers & ERM images are not counted)
+	void AnalyzeOverhangs(uint32_t layer);
+	// waits for analysis of saved images, overhangs & islands reports are written to output directory
+	void FinishOverhangsAnalysis();
 	std::pair<glm::vec2, glm::vec2> GetModelProjectionRect() const;
+	// current slice is identical to previous one & its images are saved again without rendering
+	bool IsSliceReused() const;
+
+	// vector output: current slice contours in image pixels, material on the left
+	const std::vector<Contour>& GetContours() const;
+	float GetLayerTop() const;
 
 private:
 	struct ModelData
@@ -88,26 +121,93 @@ private:
 		GLsizei idxCount = 0;
 		float zMin = 0.0f;
 		float zMax = 0.0f;
+
+		// chunk location in buffers of its batch (bytes)
+		size_t batch = 0;
+		size_t vertexOffset = 0;
+		size_t indexOffset = 0;
+	};
+
+	// vertex, normal & index buffers shared by consecutive mesh chunks
+	struct GeometryBatch
+	{
+		GLBuffer vertices;
+		GLBuffer normals;
+		GLBuffer indices;
+	};
+
+	using EncodedPng = std::shared_ptr<const std::vector<uint8_t>>;
+	using EncodedPngPromise = std::shared_ptr<std::promise<EncodedPng>>;
+
+	// image of current slice saved with given model offset (normal or ERM)
+	struct SliceImage
+	{
+		glm::vec2 modelOffset;
+		std::shared_future<EncodedPng> png;
 	};
 
-	using UniformSetterType = std::function<void(const GLProgram&)>;
-	using UniformSetters = std::vector<UniformSetterType>;
+	// image which GPU readback is in progress
+	struct PendingReadback
+	{
+		std::string fileName;
+		EncodedPngPromise encoded;
+		// image is black outside of it
+		RasterRect rect;
+		// layer number for overhangs analysis (-1: image is not analyzed)
+		int overhangsLayer;
+		// GPU difference against support of previous layer (null: support is calculated by analyzer)
+		std::shared_ptr<const std::vector<uint8_t>> overhangs;
+	};
 
 	void CreateGeometryBuffers();
+	void CreateSlicingMesh();
 
+	void Slice();
+	const SliceImage* FindSliceImage() const;
+	bool IsVectorOutput() const;
+	bool IsGpuOverhangs() const;
 	bool IsUpsideDownRendering() const;
 	bool ShouldRender(const MeshInfo& info, float inflateDistance);
 	void Render();
 	glm::mat4x4 CalculateModelTransform() const;
+	glm::mat4x4 CalculateModelTransform(const glm::vec2& modelOffset) const;
 	glm::mat4x4 CalculateViewTransform() const;
 	glm::mat4x4 CalculateProjectionTransform() const;
+	glm::mat4x4 CalculateBandTransform(float mirrorY) const;
+	glm::mat4x4 CalculateImageTransform(const glm::mat4x4& wvpMatrix) const;
 	void RenderCommon();
-	void RenderOmniDilate(float scale, uint32_t kernelSize);
+	void UpdateScissor();
+	void RenderCpu(const glm::mat4x4& wvpMatrix);
+	void SliceContours();
+	void CalculateOffsetEdges();
+	void CreateSeedTargets();
+	bool IsGpuSmallSpotsSupported() const;
+	void CreateSmallSpotsTargets();
+	bool RenderSmallSpotsMask(float pixelWeight, uint32_t kernelSize);
+	bool LabelIslands(size_t& current);
+#ifdef ANGLE
+	bool HaveLabelsChanged(size_t current);
+#endif
+	void RenderIslandAreas(const GLTexture& labelTexture, float pixelWeight);
+	glm::ivec4 GetProcessedRect() const;
+	RasterRect GetReadbackRect() const;
+	void RenderSquareDilate(float scale, uint32_t kernelSize, const GLFramebuffer& target);
+	void RenderCircleDilate(float scale, uint32_t radius, const GLFramebuffer& target);
+	void RenderMaxFilter(const GLTexture& texture, const glm::vec2& direction, uint32_t kernelSize, float baseScale, float scale);
 	void RenderDifference();
 	void RenderCombineMax(const GLTexture& additionalTexture);
-	void Render2DFilter(const GLProgram& program, const UniformSetters& additionalUniformSetters = UniformSetters());
+	void Render2DFilter(Filter2D& filter, const GLTexture& texture);
 	void RenderOffscreen();
 	void RenderFullscreen();
+	void SavePngBanded(const std::string& fileName);
+	EncodedPngPromise KeepSliceImage();
+	void SaveRaster(const std::string& fileName, std::vector<uint8_t> raster, const RasterRect& rect, const EncodedPngPromise& encoded,
+		int overhangsLayer, std::shared_ptr<const std::vector<uint8_t>> overhangs);
+	void RequestReadback();
+	void ReceiveReadback();
+	void SetColorMask();
+	void SetBlackClearColor();
+	void QueuePngSave(std::future<void> future);
 
 	void Model(const glm::mat4x4& wvpMatrix, float inflateDistance);
 	void Mask(const glm::mat4x4& wvpMatrix, const glm::mat4x4& wvMatrix, const GLTexture& mask);
@@ -132,9 +232,25 @@ private:
 	GLuint maskTextureUniform_;
 	GLuint maskPlateSizeUniform_;
 
-	GLProgram omniDilateProgram_;
-	GLProgram differenceProgram_;
-	GLProgram combineMaxProgram_;
+	GLProgram islandAreaProgram_;
+	GLuint islandAreaPixelAttrib_;
+	GLuint islandAreaTexelSizeUniform_;
+	GLuint islandAreaLabelTextureUniform_;
+	GLuint islandAreaCoverageTextureUniform_;
+	GLuint islandAreaPixelWeightUniform_;
+
+	Filter2D maxFilter_;
+	Filter2D seedFilter_;
+	Filter2D jumpFloodStepFilter_;
+	Filter2D jumpFloodDilateFilter_;
+	Filter2D differenceFilter_;
+	Filter2D combineMaxFilter_;
+	Filter2D labelPropagateFilter_;
+#ifdef ANGLE
+	Filter2D labelChangedFilter_;
+#endif
+	Filter2D labelFringeFilter_;
+	Filter2D smallSpotsMaskFilter_;
 
 	GLTexture maskTexture_;
 	GLTexture whiteTexture_;
@@ -142,24 +258,76 @@ private:
 	GLFramebuffer imageFBO_;
 	GLTexture imageTexture_;
 
+	// GPU overhangs: support of previous layer
 	GLFramebuffer previousLayerImageFBO_;
 	GLTexture previousLayerImageTexture_;
 
 	GLFramebuffer temporaryFBO_;
 	GLTexture temporaryTexture_;
 
-	std::vector<GLBuffer> vBuffers_;
-	std::vector<GLBuffer> nBuffers_;
-	std::vector<GLBuffer> iBuffers_;
+	// pixel coordinates ping-pong: nearest seeds for GPU circular support, island labels for small spots
+	std::array<GLFramebuffer, 2> seedFBOs_;
+	std::array<GLTexture, 2> seedTextures_;
+
+	// GPU small spots processing: island areas are accumulated at label pixels (half float),
+	// mask stays in texture
+	bool gpuSmallSpots_;
+	GLFramebuffer islandAreaFBO_;
+	GLTexture islandAreaTexture_;
+	GLFramebuffer smallSpotsMaskFBO_;
+	GLTexture smallSpotsMaskTexture_;
+	// coordinates of every surface pixel, drawn as points by island area pass
+	GLBuffer pixelsBuffer_;
+#ifdef ANGLE
+	GLQuery labelsChangedQuery_;
+#endif
+
+	std::vector<GeometryBatch> batches_;
 	std::vector<MeshInfo> meshInfo_;
+	// GL_OES_element_index_uint: chunks are rebased to batch & adjacent ones are drawn at once
+	bool uintIndices_;
+
+	std::unique_ptr<MeshSlicer> meshSlicer_;
+	std::unique_ptr<CoverageRasterizer> rasterizer_;
+	std::vector<SliceEdge> sliceEdges_;
+	std::vector<SliceEdge> offsetEdges_;
+	std::vector<Contour> contours_;
 
 	ModelData model_;
 	Settings settings_;
 
 	glm::vec2 modelOffset_;
 
+	// offset of last rendered image, it's restored by ERM before saving
+	glm::vec2 renderedModelOffset_;
+	// shift subtracted from model offset while ERM image is rendered
+	glm::vec2 ermShift_;
+
+	// banded mode: slice is rendered band by band while saving
+	uint32_t bandOrigin_;
+	std::future<void> bandWriteResult_;
+
+	// small spots mask of current slice & model offset of image it is calculated from
+	bool smallSpotsMaskValid_;
+	glm::vec2 smallSpotsMaskOffset_;
+	// mask is in smallSpotsMaskTexture_, otherwise it's made on CPU & uploaded to maskTexture_
+	bool smallSpotsMaskOnGpu_;
+
+	// model footprint in image pixels: left, bottom, right, top (offscreen GL rendering)
+	glm::ivec4 scissorRect_;
+
 	const std::vector<uint32_t> palette_;
 	std::vector<std::future<void>> pngSaveResult_;
+	std::vector<SliceImage> sliceImages_;
+	// images rendered into channels of current render target, read back together when all are filled
+	std::vector<PendingReadback> packedImages_;
+	std::deque<std::vector<PendingReadback>> pendingReadbacks_;
+	bool sliceReused_;
 	std::vector<uint8_t> raster_;
+	std::unique_ptr<OverhangAnalyzer> overhangAnalyzer_;
+	// layer number of image saved next (-1: image is not analyzed)
+	int overhangsLayer_;
+	// GPU difference of image saved next
+	std::shared_ptr<const std::vector<uint8_t>> overhangs_;
 	std::unique_ptr<IGlContext> glContext_;
 };
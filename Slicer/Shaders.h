@@ -75,29 +75,124 @@ const std::string Filter2DVShader = SHADER
 	}
 );
 
-const std::string OmniDilateFShader = SHADER
+// Max over kernelSize texels along direction (square kernel is dilated by horizontal & vertical passes),
+// result is added to base texture.
+const std::string MaxFilterFShader = SHADER
 (
 	precision mediump float;
 
 	varying vec2 texCoord;
 	uniform vec2 texelSize;
 	uniform sampler2D texture;
+	uniform sampler2D baseTexture;
+	uniform vec2 direction;
 	uniform float kernelSize;
+	uniform float baseScale;
 	uniform float scale;
 
 	void main()
 	{
-		vec4 maxColor = vec4(0);
-		vec2 offset = vec2(floor(kernelSize / 2.0));
-		for (float dy = 0.0; dy < kernelSize; ++dy)
+		float maxValue = 0.0;
+		float offset = floor(kernelSize / 2.0);
+		for (float d = 0.0; d < kernelSize; ++d)
 		{
-			for (float dx = 0.0; dx < kernelSize; ++dx)
+			maxValue = max(maxValue, texture2D(texture, texCoord + texelSize*direction*(d - offset)).r);
+		}
+
+		gl_FragColor = vec4(vec3(texture2D(baseTexture, texCoord).r*baseScale + maxValue*scale), 1);
+	}
+);
+
+// Pixel coordinates (jump flooding seeds, island labels) are kept in RGBA texture as 16-bit x & y,
+// 0xFFFF marks pixel without coordinates.
+const std::string PixelCoordinatesCoding = SHADER
+(
+	const float NoSeed = 65535.0;
+
+	vec4 EncodeSeed(vec2 seed)
+	{
+		vec2 high = floor(seed / 256.0);
+		return vec4(high.x, seed.x - high.x * 256.0, high.y, seed.y - high.y * 256.0) / 255.0;
+	}
+
+	vec2 DecodeSeed(vec4 value)
+	{
+		vec4 bytes = floor(value * 255.0 + 0.5);
+		return vec2(bytes.x * 256.0 + bytes.y, bytes.z * 256.0 + bytes.w);
+	}
+
+	bool IsBefore(vec2 a, vec2 b)
+	{
+		return a.y < b.y || (a.y == b.y && a.x < b.x);
+	}
+);
+
+const std::string PixelCoordinatesFilter = SHADER
+(
+	precision highp float;
+
+	varying vec2 texCoord;
+	uniform vec2 texelSize;
+	uniform sampler2D texture;
+) + PixelCoordinatesCoding + SHADER
+(
+	vec2 CurrentPixel()
+	{
+		return floor(texCoord / texelSize);
+	}
+);
+
+// Pixels covered at least by threshold get their own coordinates.
+const std::string SeedFShader = PixelCoordinatesFilter + SHADER
+(
+	uniform float threshold;
+
+	void main()
+	{
+		gl_FragColor = texture2D(texture, texCoord).r >= threshold ? EncodeSeed(CurrentPixel()) : vec4(1);
+	}
+);
+
+const std::string JumpFloodStepFShader = PixelCoordinatesFilter + SHADER
+(
+	uniform float stepSize;
+
+	void main()
+	{
+		vec2 pixel = CurrentPixel();
+		vec2 nearestSeed = vec2(NoSeed);
+		float nearestDistance = 0.0;
+		for (float dy = -1.0; dy <= 1.0; ++dy)
+		{
+			for (float dx = -1.0; dx <= 1.0; ++dx)
 			{
-				maxColor = max(maxColor, texture2D(texture, texCoord + texelSize*(vec2(dx, dy) - offset)));
+				vec2 seed = DecodeSeed(texture2D(texture, texCoord + texelSize*vec2(dx, dy)*stepSize));
+				vec2 delta = seed - pixel;
+				float seedDistance = dot(delta, delta);
+				if (seed.x < NoSeed && (nearestSeed.x == NoSeed || seedDistance < nearestDistance))
+				{
+					nearestSeed = seed;
+					nearestDistance = seedDistance;
+				}
 			}
 		}
 
-		gl_FragColor = texture2D(texture, texCoord) + maxColor*scale;
+		gl_FragColor = EncodeSeed(nearestSeed);
+	}
+);
+
+// Circular dilation by distance to nearest seed (antialiased by half pixel), result is added to base texture.
+const std::string JumpFloodDilateFShader = PixelCoordinatesFilter + SHADER
+(
+	uniform sampler2D baseTexture;
+	uniform float radius;
+	uniform float scale;
+
+	void main()
+	{
+		vec2 seed = DecodeSeed(texture2D(texture, texCoord));
+		float coverage = seed.x < NoSeed ? clamp(radius + 0.5 - distance(seed, CurrentPixel()), 0.0, 1.0) : 0.0;
+		gl_FragColor = vec4(vec3(texture2D(baseTexture, texCoord).r + coverage*scale), 1);
 	}
 );
 
@@ -111,8 +206,8 @@ const std::string DifferenceFShader = SHADER
 
 	void main()
 	{
-		vec4 color = texture2D(texture, texCoord) - texture2D(previousLayerTexture, texCoord);
-		gl_FragColor = color;
+		float value = texture2D(texture, texCoord).r - texture2D(previousLayerTexture, texCoord).r;
+		gl_FragColor = vec4(vec3(value), 1);
 	}
 );
 
@@ -126,7 +221,144 @@ const std::string CombineMaxFShader = SHADER
 
 	void main()
 	{
-		vec4 color = max(texture2D(texture, texCoord), texture2D(combineTexture, texCoord));
-		gl_FragColor = color;
+		float value = max(texture2D(texture, texCoord).r, texture2D(combineTexture, texCoord).r);
+		gl_FragColor = vec4(vec3(value), 1);
+	}
+);
+
+// Island labelling: labelled pixel takes the first label of its 8 neighbours & label of its label's pixel
+// (pointer jumping), so every island converges to coordinates of its first pixel.
+const std::string LabelPropagateFShader = PixelCoordinatesFilter + SHADER
+(
+	void main()
+	{
+		vec2 label = DecodeSeed(texture2D(texture, texCoord));
+		if (label.x < NoSeed)
+		{
+			for (float dy = -1.0; dy <= 1.0; ++dy)
+			{
+				for (float dx = -1.0; dx <= 1.0; ++dx)
+				{
+					vec2 neighbour = DecodeSeed(texture2D(texture, texCoord + texelSize*vec2(dx, dy)));
+					if (IsBefore(neighbour, label))
+					{
+						label = neighbour;
+					}
+				}
+			}
+
+			vec2 rootLabel = DecodeSeed(texture2D(texture, (label + 0.5) * texelSize));
+			if (IsBefore(rootLabel, label))
+			{
+				label = rootLabel;
+			}
+		}
+
+		gl_FragColor = EncodeSeed(label);
+	}
+);
+
+// Passes only pixels which differ between textures (counted by occlusion query).
+const std::string LabelChangedFShader = SHADER
+(
+	precision highp float;
+
+	varying vec2 texCoord;
+	uniform sampler2D texture;
+	uniform sampler2D previousTexture;
+
+	void main()
+	{
+		if (all(equal(texture2D(texture, texCoord), texture2D(previousTexture, texCoord))))
+		{
+			discard;
+		}
+		gl_FragColor = vec4(1);
+	}
+);
+
+// Partially covered pixel around islands belongs to the first island touching it.
+const std::string LabelFringeFShader = PixelCoordinatesFilter + SHADER
+(
+	uniform sampler2D coverageTexture;
+
+	void main()
+	{
+		vec2 label = DecodeSeed(texture2D(texture, texCoord));
+		if (label.x == NoSeed && texture2D(coverageTexture, texCoord).r > 0.0)
+		{
+			for (float dy = -1.0; dy <= 1.0; ++dy)
+			{
+				for (float dx = -1.0; dx <= 1.0; ++dx)
+				{
+					vec2 neighbour = DecodeSeed(texture2D(texture, texCoord + texelSize*vec2(dx, dy)));
+					if (IsBefore(neighbour, label))
+					{
+						label = neighbour;
+					}
+				}
+			}
+		}
+
+		gl_FragColor = EncodeSeed(label);
+	}
+);
+
+// Every labelled pixel is drawn as a point onto its island label pixel, so additive blending
+// sums island area there (in units of small spot threshold).
+const std::string IslandAreaVShader = SHADER
+(
+	attribute vec2 vPixel;
+	uniform vec2 texelSize;
+	uniform sampler2D labelTexture;
+	uniform sampler2D coverageTexture;
+	uniform float pixelWeight;
+
+	varying vec4 weight;
+) + PixelCoordinatesCoding + SHADER
+(
+	void main()
+	{
+		vec2 pixelCoord = (vPixel + 0.5) * texelSize;
+		vec2 label = DecodeSeed(texture2D(labelTexture, pixelCoord));
+
+		// pixels of each 2x2 block go to different channels, so each half float sum gets quarter of island pixels
+		float channel = mod(vPixel.x, 2.0) + 2.0 * mod(vPixel.y, 2.0);
+		vec4 channelMask = vec4(1.0) - step(0.5, abs(vec4(0.0, 1.0, 2.0, 3.0) - channel));
+		weight = channelMask * texture2D(coverageTexture, pixelCoord).r * pixelWeight;
+
+		gl_Position = label.x < NoSeed ? vec4((label + 0.5) * texelSize * 2.0 - 1.0, 0, 1) : vec4(2, 2, 0, 1);
+		gl_PointSize = 1.0;
+	}
+);
+
+const std::string IslandAreaFShader = SHADER
+(
+	precision mediump float;
+
+	varying vec4 weight;
+
+	void main()
+	{
+		gl_FragColor = weight;
+	}
+);
+
+// Small spots mask: pixels of islands not larger than threshold are set, pixels of larger ones are cleared,
+// unlabelled pixels keep their coverage.
+const std::string SmallSpotsMaskFShader = PixelCoordinatesFilter + SHADER
+(
+	uniform sampler2D coverageTexture;
+	uniform sampler2D areaTexture;
+
+	void main()
+	{
+		vec2 label = DecodeSeed(texture2D(texture, texCoord));
+		float value = texture2D(coverageTexture, texCoord).r;
+		if (label.x < NoSeed)
+		{
+			value = dot(texture2D(areaTexture, (label + 0.5) * texelSize), vec4(1.0)) > 1.0 ? 0.0 : 1.0;
+		}
+		gl_FragColor = vec4(vec3(value), 1);
 	}
 );
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "Utils.h"
 
 #include <PngFile.h>
+#include <VectorFile.h>
 #include <Raster.h>
 #include <PerfTimer.h>
 #include <ErrorHandling.h>
@@ -36,17 +37,28 @@ void WriteWhiteLayers(const Settings& settings, const std::pair<glm::vec2, glm::
 	const int xEnd = std::min(static_cast<int>(settings.renderWidth), static_cast<int>(bounds.second.x + xBorder));
 	const int yEnd = std::min(static_cast<int>(settings.renderHeight), static_cast<int>(bounds.second.y + yBorder));
 
-	std::vector<uint8_t> data(settings.renderWidth * settings.renderHeight, 0);
-	ForEachPixel(std::make_pair(xStart, xEnd), std::make_pair(yStart, yEnd), [&data, &settings](auto x, auto y) {
+	// image is written row by row, so only black & basement rows are kept
+	std::vector<uint8_t> blackRow(settings.renderWidth, 0);
+	std::vector<uint8_t> basementRow(settings.renderWidth, 0);
+	if (xEnd > xStart)
+	{
 		const uint8_t WhiteColorPaletteIndex = 0xFF;
-		data[y * settings.renderWidth + x] = WhiteColorPaletteIndex;
-	});
+		std::fill(basementRow.begin() + xStart, basementRow.begin() + xEnd, WhiteColorPaletteIndex);
+	}
+
+	// set large buffer to write whole image in single IDAT
+	// to workaround Perfactory PNG reader bug (not in banded mode, it bounds memory).
+	const size_t compressionBufferSize = settings.IsBanded() ? 0 : settings.renderWidth * settings.renderHeight;
 
 	const auto palette = CreateGrayscalePalette();
 	for (uint32_t i = 0; i < settings.whiteLayers; ++i)
 	{
 		const auto filePath = (outputDir / GetOutputFileName(settings, i)).string();
-		WritePng(filePath, settings.renderWidth, settings.renderHeight, 8, data, palette);
+		PngWriter writer(filePath, settings.renderWidth, settings.renderHeight, 8, 1, palette, compressionBufferSize);
+		for (int y = 0; y < static_cast<int>(settings.renderHeight); ++y)
+		{
+			writer.WriteRows(y >= yStart && y < yEnd ? basementRow.data() : blackRow.data(), 1);
+		}
 	}	
 }
 
@@ -62,18 +74,26 @@ void RenderModel(Renderer& r, const Settings& settings)
 	}
 	
 	uint32_t nSlice = 0;
+	uint32_t nReusedSlices = 0;
 	uint32_t imageNumber = settings.whiteLayers;
 	r.FirstSlice();
 	do
 	{
-		auto filePath = (outputDir / GetOutputFileName(settings, imageNumber++)).string();
-		r.SavePng(filePath);
-	
+		if (r.IsSliceReused())
+		{
+			BOOST_LOG_TRIVIAL(info) << "Slice " << nSlice << " is reused";
+			++nReusedSlices;
+		}
+
+		// image is analyzed while being saved
 		if (settings.doOverhangAnalysis)
 		{
-			r.AnalyzeOverhangs(imageNumber-1);
+			r.AnalyzeOverhangs(nSlice);
 		}
 
+		auto filePath = (outputDir / GetOutputFileName(settings, imageNumber++)).string();
+		r.SavePng(filePath);
+
 		if (settings.enableERM)
 		{
 			r.ERM();
@@ -83,8 +103,14 @@ void RenderModel(Renderer& r, const Settings& settings)
 
 		++nSlice;
 	} while (r.NextSlice());
+	r.WaitForSaving();
+	if (settings.doOverhangAnalysis)
+	{
+		r.FinishOverhangsAnalysis();
+	}
 
 	BOOST_LOG_TRIVIAL(info) << "Total slices: " << nSlice;
+	BOOST_LOG_TRIVIAL(info) << "Reused slices: " << nReusedSlices;
 
 	if (!settings.simulate)
 	{
@@ -92,6 +118,48 @@ void RenderModel(Renderer& r, const Settings& settings)
 	}
 }
 
+void RenderContours(Renderer& r, const Settings& settings)
+{
+	PerfTimer renderTime("Render time");
+	const auto outputDir = boost::filesystem::path(settings.outputDir);
+
+	// whole job is written into single CLI file
+	std::unique_ptr<CliWriter> cliWriter;
+	if (!settings.simulate)
+	{
+		boost::filesystem::create_directories(settings.outputDir);
+		if (settings.outputFormat == "cli")
+		{
+			const glm::vec2 pixelSize(settings.plateWidth / settings.renderWidth, settings.plateHeight / settings.renderHeight);
+			cliWriter.reset(new CliWriter((outputDir / "job.cli").string(), pixelSize));
+		}
+	}
+
+	uint32_t nSlice = 0;
+	r.FirstSlice();
+	do
+	{
+		if (cliWriter)
+		{
+			cliWriter->AddLayer(r.GetLayerTop(), r.GetContours());
+		}
+		else if (!settings.simulate)
+		{
+			const auto filePath = (outputDir / GetOutputFileName(settings, nSlice)).string();
+			WriteSvg(filePath, settings.renderWidth, settings.renderHeight, settings.plateWidth, settings.plateHeight, r.GetContours());
+		}
+
+		++nSlice;
+	} while (r.NextSlice());
+
+	if (cliWriter)
+	{
+		cliWriter->Close();
+	}
+
+	BOOST_LOG_TRIVIAL(info) << "Total slices: " << nSlice;
+}
+
 int main(int argc, char** argv)
 {
 	try
@@ -116,12 +184,17 @@ int main(int argc, char** argv)
 		config.add_options()
 			("modelFile,m", po::value<std::string>(&settings.modelFile), "model to process")
 			("outputDir,o", po::value<std::string>(&settings.outputDir), "output directory")
+			("outputFormat", po::value<std::string>(&settings.outputFormat)->default_value(settings.outputFormat), "output format: png, svg (contours per layer) or cli (contours of whole job)")
 
 			("step", po::value<float>(&settings.step)->default_value(settings.step), "slicing step (mm)")
 
 			("renderWidth", po::value<uint32_t>(&settings.renderWidth)->default_value(settings.renderWidth), "image x resolution")
 			("renderHeight", po::value<uint32_t>(&settings.renderHeight)->default_value(settings.renderHeight), "image y resolution")
-			("samples", po::value<uint32_t>(&settings.samples)->default_value(settings.samples), "samples per pixel")
+			("bandHeight", po::value<uint32_t>(&settings.bandHeight)->default_value(settings.bandHeight), "render & save images by horizontal bands of given height to bound memory (0 - whole image)")
+			("samples", po::value<uint32_t>(&settings.samples)->default_value(settings.samples), "samples per pixel (with CPU rendering any non-zero value turns on antialiasing)")
+			("cpuRendering", po::value<bool>(&settings.cpuRendering)->default_value(settings.cpuRendering), "rasterize slices on CPU with exact coverage antialiasing")
+			("reuseSlices", po::value<bool>(&settings.reuseSlices)->default_value(settings.reuseSlices), "save identical consecutive slices without rendering (keeps extra mesh copy with GL rendering, off with GL inflate & small spots processing)")
+			("packedSlices", po::value<uint32_t>(&settings.packedSlices)->default_value(settings.packedSlices), "render up to 4 consecutive images into color channels of single image & read them back at once (offscreen GL rendering)")
 
 			("plateWidth", po::value<float>(&settings.plateWidth)->default_value(settings.plateWidth), "platform width (mm)")
 			("plateHeight", po::value<float>(&settings.plateHeight)->default_value(settings.plateHeight), "platform height (mm)")
@@ -133,8 +206,10 @@ int main(int argc, char** argv)
 			("smallSpotThreshold", po::value<float>(&settings.smallSpotThreshold)->default_value(settings.smallSpotThreshold), "maximum small spot area (mm^2)")
 			("smallSpotInflateDistance", po::value<float>(&settings.smallSpotInflateDistance)->default_value(settings.smallSpotInflateDistance), "small spot inflate distance (mm)")
 
-			("doOverhangAnalysis,a", po::value<bool>(&settings.doOverhangAnalysis)->default_value(settings.doOverhangAnalysis), "analyze unsupported model parts")
+			("doOverhangAnalysis,a", po::value<bool>(&settings.doOverhangAnalysis)->default_value(settings.doOverhangAnalysis), "analyze unsupported model parts (overhangs of each layer & islands through layers are reported to overhangs.csv & islands.csv in output directory, layers are slice numbers from 0)")
 			("maxSupportedDistance", po::value<float>(&settings.maxSupportedDistance)->default_value(settings.maxSupportedDistance), "maximum length of overhang upon previous layer (mm)")
+			("supportKernel", po::value<std::string>(&settings.supportKernel)->default_value(settings.supportKernel), "area supported by previous layer: square or circle around its pixels")
+			("gpuOverhangs", po::value<bool>(&settings.gpuOverhangs)->default_value(settings.gpuOverhangs), "render overhangs as GPU difference against dilated previous layer (separable max filter or jump flooding), GL rendering without packed slices only")
 
 			("enableERM,e", po::value<bool>(&settings.enableERM)->default_value(settings.enableERM), "enable ERM mode")
 			("envisiontechTemplatesPath", po::value<std::string>(&settings.envisiontechTemplatesPath)->default_value(settings.envisiontechTemplatesPath), "envisiontech job templates path")
@@ -185,7 +260,14 @@ int main(int argc, char** argv)
 		}
 
 		Renderer r(settings);
-		RenderModel(r, settings);
+		if (settings.outputFormat == "png")
+		{
+			RenderModel(r, settings);
+		}
+		else
+		{
+			RenderContours(r, settings);
+		}
 
 		PROCESS_MEMORY_COUNTERS pmc{};
 		GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
@@ -1,4 +1,5 @@
 #include "Utils.h"
+#include "Renderer.h"
 
 const auto SliceFileDigits = 5;
 
@@ -11,6 +12,6 @@ std::string ReplaceAll(const std::string & str, const std::string & what, const
 std::string GetOutputFileName(const Settings & settings, uint32_t slice)
 {
 	std::stringstream s;
-	s << std::setfill('0') << std::setw(SliceFileDigits) << slice << ".png";
+	s << std::setfill('0') << std::setw(SliceFileDigits) << slice << "." << settings.outputFormat;
 	return s.str();
 }
\ No newline at end of file
@@ -1 +1 @@
-g++ -std=c++11 -O2 -ftree-vectorize -pipe -DHAVE_LIBBCM_HOST -I/opt/vc/include/ -I/opt/vc/include/interface/vcos/pthreads -I/opt/vc/include/interface/vmcs_host/linux -I./ -L/opt/vc/lib/ -lpng -lGLESv2 -lEGL -lbcm_host -lpthread Slicer.cpp Renderer.cpp Geometry.cpp Loaders.cpp Png.cpp CacheOpt.cpp Raster.cpp GlContext.cpp GlContextRPi.cpp -o Slicer
+g++ -std=c++11 -O2 -ftree-vectorize -pipe -DHAVE_LIBBCM_HOST -I/opt/vc/include/ -I/opt/vc/include/interface/vcos/pthreads -I/opt/vc/include/interface/vmcs_host/linux -I./ -L/opt/vc/lib/ -lpng -lGLESv2 -lEGL -lbcm_host -lpthread Slicer.cpp Renderer.cpp Geometry.cpp Loaders.cpp Png.cpp CacheOpt.cpp Raster.cpp RasterKernels.cpp BitRaster.cpp RunRaster.cpp OverhangAnalyzer.cpp IslandTracker.cpp Rasterizer.cpp MeshSlicer.cpp Contours.cpp VectorFile.cpp Filter2D.cpp GlContext.cpp GlContextRPi.cpp -o Slicer
@@ -0,0 +1,157 @@
+// Vector raster kernels should give the same results as scalar ones for any row length & alignment.
+
+#include <RasterKernels.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// Rows start at offset from allocation, so vector loads are unaligned as in image rows.
+	struct TestRow
+	{
+		std::vector<uint8_t> a;
+		std::vector<uint8_t> b;
+		size_t offset;
+		size_t count;
+		uint8_t threshold;
+	};
+
+	using Kernel = std::function<std::vector<size_t>(const TestRow&)>;
+
+	// Lit pixels are rare in some rows, so search kernels skip whole vectors as well.
+	std::vector<TestRow> CreateRows()
+	{
+		std::mt19937 random(12345);
+		std::uniform_int_distribution<int> values(0, 255);
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+		std::vector<size_t> counts;
+		for (size_t count = 0; count <= 130; ++count)
+		{
+			counts.push_back(count);
+		}
+		counts.push_back(1000);
+		counts.push_back(4099);
+
+		std::vector<TestRow> rows;
+		for (const auto count : counts)
+		{
+			for (size_t offset = 0; offset < 4; ++offset)
+			{
+				for (const auto litProbability : { 1.0f, 0.01f })
+				{
+					TestRow row = { std::vector<uint8_t>(offset + count), std::vector<uint8_t>(offset + count), offset, count,
+						static_cast<uint8_t>(values(random)) };
+					for (size_t i = 0; i < row.a.size(); ++i)
+					{
+						row.a[i] = static_cast<uint8_t>(uniform(random) < litProbability ? values(random) : 0);
+						row.b[i] = static_cast<uint8_t>(values(random));
+					}
+					rows.push_back(row);
+				}
+			}
+		}
+		return rows;
+	}
+
+	std::vector<size_t> ToResult(const std::vector<uint8_t>& pixels)
+	{
+		return std::vector<size_t>(pixels.begin(), pixels.end());
+	}
+
+	// out is a separate row & the first input row (kernels of two rows may write in place).
+	Kernel TwoRows(void (*kernel)(const uint8_t*, const uint8_t*, uint8_t*, size_t))
+	{
+		return [kernel](const TestRow& row) {
+			std::vector<uint8_t> out(row.count + 1, 0xCD);
+			kernel(&row.a[row.offset], &row.b[row.offset], out.data(), row.count);
+
+			auto inPlace = row.a;
+			kernel(&inPlace[row.offset], &row.b[row.offset], &inPlace[row.offset], row.count);
+			out.insert(out.end(), inPlace.begin(), inPlace.end());
+			return ToResult(out);
+		};
+	}
+
+	Kernel ThreePixels(void (*kernel)(const uint8_t*, uint8_t*, size_t))
+	{
+		return [kernel](const TestRow& row) {
+			std::vector<uint8_t> out(row.count + 1, 0xCD);
+			kernel(&row.a[row.offset], out.data(), row.count);
+			return ToResult(out);
+		};
+	}
+
+	Kernel Search(size_t (*kernel)(const uint8_t*, size_t, uint8_t))
+	{
+		return [kernel](const TestRow& row) {
+			return std::vector<size_t>{ kernel(&row.a[row.offset], row.count, row.threshold) };
+		};
+	}
+
+	// Number of rows where given instruction set differs from scalar kernels.
+	size_t CountMismatches(const std::string& instructionSet, const Kernel& kernel, const std::vector<TestRow>& rows)
+	{
+		size_t mismatches = 0;
+		for (const auto& row : rows)
+		{
+			SelectRasterKernels("scalar");
+			const auto expected = kernel(row);
+			SelectRasterKernels(instructionSet.c_str());
+			if (kernel(row) != expected)
+			{
+				++mismatches;
+			}
+		}
+		return mismatches;
+	}
+} //namespace
+
+int main()
+{
+	const std::vector<std::pair<std::string, Kernel>> kernels = {
+		{ "MaxRows", TwoRows(MaxRows) },
+		{ "MinRows", TwoRows(MinRows) },
+		{ "SubtractRows", TwoRows(SubtractRows) },
+		{ "ThresholdRow", [](const TestRow& row) {
+			std::vector<uint8_t> out(row.count + 1, 0xCD);
+			ThresholdRow(&row.a[row.offset], out.data(), row.count, row.threshold);
+			return ToResult(out);
+		} },
+		{ "FindFirstNotBelow", Search(FindFirstNotBelow) },
+		{ "FindEndNotBelow", Search(FindEndNotBelow) },
+		{ "MaxRow3", ThreePixels(MaxRow3) },
+		{ "MinRow3", ThreePixels(MinRow3) },
+	};
+
+	const auto rows = CreateRows();
+	auto failed = false;
+	for (const auto instructionSet : { "SSE2", "AVX2" })
+	{
+		if (!SelectRasterKernels(instructionSet))
+		{
+			std::cout << instructionSet << ": not supported, skipped\n";
+			continue;
+		}
+
+		for (const auto& kernel : kernels)
+		{
+			const auto mismatches = CountMismatches(instructionSet, kernel.second, rows);
+			std::cout << instructionSet << " " << kernel.first << ": " << (mismatches == 0 ? "OK" : "FAILED");
+			if (mismatches != 0)
+			{
+				std::cout << " (" << mismatches << " of " << rows.size() << " rows)";
+				failed = true;
+			}
+			std::cout << "\n";
+		}
+	}
+
+	return failed ? 1 : 0;
+}
\ No newline at end of file
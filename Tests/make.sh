@@ -0,0 +1 @@
+g++ -std=c++11 -O2 -I../Common ../Common/RasterKernels.cpp RasterKernelsTest.cpp -o RasterKernelsTest && ./RasterKernelsTest